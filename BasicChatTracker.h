@@ -0,0 +1,2029 @@
+#ifndef BASICCHATTRACKER_INCLUDED
+#define BASICCHATTRACKER_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ChatColdFile.h"
+#include "ChatEventFeed.h"
+#include "PagedColumn.h"
+#include "SharedRegion.h"
+
+  // What a BasicChatTracker is keyed and counted by.  A policy is any
+  // struct with these four members:
+  //   Key           std::string_view for names, or an unsigned integer type
+  //                 for users and chats the caller has already numbered
+  //                 (densely from 0, since ids index the tables directly,
+  //                 and below 0xFFFFFFFE, since ids are 32 bits and the top
+  //                 two are taken; join throws std::out_of_range for more)
+  //   Count         the (signed) type of a contribution count and a chat's total
+  //   Hash          hashes a std::string_view (unused for integer keys)
+  //   keepDeparted  if false, a membership is freed as soon as it is left
+  //                 and only its count is kept, added into its chat's total
+  // This is the policy ChatTracker uses, and the only one whose tables
+  // ChatSnapshot and ChatTrackerReader understand.
+struct ChatTrackerPolicy
+{
+    using Key = std::string_view;
+    using Count = int;
+    using Hash = std::hash<std::string_view>;
+    static const bool keepDeparted = true;
+};
+
+// names are kept in pages of 64K characters, so a name can't be longer
+const int NAME_PAGE_SHIFT = 16;
+
+// what a ChatSnapshot sees: the tracker's columns as they were when it was taken
+struct ChatSnapshotState
+{
+    ColumnView<std::uint32_t, 12> userOffset, userLength;
+    ColumnView<char, NAME_PAGE_SHIFT> userChars;
+    ColumnView<std::uint32_t, 12> chatBucket, chatNext, chatOffset, chatLength;
+    ColumnView<char, NAME_PAGE_SHIFT> chatChars;
+    ColumnView<std::uint32_t, 12> chatHead;
+    ColumnView<std::uint32_t, 12> user, chat, userPrev, chatLink;
+    ColumnView<int, 12> count;
+    ColumnView<std::uint32_t, 12> gen, chatGen;
+
+    // false for a membership of a chat terminated since it was made
+    bool live(std::uint32_t m) const { return gen[m] == chatGen[chat[m]]; }
+
+    std::string_view userName(std::uint32_t id) const
+    {
+        if(userLength[id] == 0)
+            return std::string_view();
+        return std::string_view(&userChars[userOffset[id]], userLength[id]);
+    }
+    std::string_view chatName(std::uint32_t id) const
+    {
+        if(chatLength[id] == 0)
+            return std::string_view();
+        return std::string_view(&chatChars[chatOffset[id]], chatLength[id]);
+    }
+};
+
+// ChatNameTable gives every distinct user (or chat) name a small id,
+// so the membership columns only store 32-bit ids instead of strings
+template <typename Hash>
+struct ChatNameTable
+{
+    static constexpr std::uint32_t NIL = 0xFFFFFFFF;
+    // the offset of an id that a ChatNumberTable has taken
+    static constexpr std::uint32_t NUMBERED = 0xFFFFFFFE;
+
+    // a name together with Hash()(s), which the caller may have
+    // computed ahead of time (see ChatCommand)
+    struct Arg
+    {
+        Arg(const std::string& str) : s(str), h(Hash()(s)) {}
+        Arg(std::string_view str) : s(str), h(Hash()(s)) {}
+        Arg(std::string_view str, std::size_t hv) : s(str), h(hv) {}
+        std::string_view s;
+        std::size_t h;
+    };
+    using Owned = std::string;
+
+    int max_buckets;
+    PagedColumn<std::uint32_t> bucket;  // first id in each bucket
+    PagedColumn<std::uint32_t> next;    // next id in the same bucket, or next free id
+    PagedColumn<std::uint32_t> offset;  // where each name starts in chars, NIL for a free id, or NUMBERED
+    PagedColumn<std::uint32_t> length;
+    PagedColumn<char, NAME_PAGE_SHIFT> chars;  // all the names, none split across pages
+    std::size_t garbage;                // chars that belong to no name
+    std::uint32_t freeId;
+
+    ChatNameTable(Epochs* e)
+     : max_buckets(0), bucket(e), next(e), offset(e), length(e), chars(e), garbage(0), freeId(NIL) {}
+
+    void generateHash(int buckets)
+    {
+        max_buckets = buckets;
+        bucket.assign(max_buckets, NIL);
+    }
+
+    //empties the table but keeps its pages
+    void reset()
+    {
+        bucket.assign(max_buckets, NIL);
+        next.reuse();
+        offset.reuse();
+        length.reuse();
+        chars.reuse();
+        garbage = 0;
+        freeId = NIL;
+    }
+
+    std::string_view name(std::uint32_t id) const
+    {
+        if(length[id] == 0)
+            return std::string_view();
+        return std::string_view(&chars[offset[id]], length[id]);
+    }
+    bool isFree(std::uint32_t id) const { return offset[id] == NIL; }
+    Owned owned(std::uint32_t id) const { return Owned(name(id)); }
+    std::size_t bucketOf(const Arg& n) const { return n.h % max_buckets; }
+
+    std::uint32_t find(const Arg& n) const
+    {
+        for(std::uint32_t id = bucket[bucketOf(n)]; id != NIL; id = next[id])
+        {
+            if(name(id) == n.s)
+                return id;
+        }
+        return NIL;
+    }
+
+    //a name is kept in one page of chars, so it can be no longer than one
+    static constexpr std::size_t MAX_NAME = std::size_t(1) << NAME_PAGE_SHIFT;
+
+    //throws std::length_error, before changing anything, for a name over MAX_NAME
+    std::uint32_t intern(const Arg& n, Epochs* e)
+    {
+        if(n.s.size() > MAX_NAME)
+            throw std::length_error("ChatNameTable: name longer than 65536 characters");
+        std::size_t hash_v = bucketOf(n);
+        for(std::uint32_t id = bucket[hash_v]; id != NIL; id = next[id])
+        {
+            if(name(id) == n.s)
+                return id;
+        }
+
+        std::uint32_t id = newId();
+        std::size_t end = chars.size();
+        std::size_t start = chars.appendContiguous(n.s.data(), n.s.size());
+        garbage += start - end;  //the rest of a page that was too full
+        offset.edit(id) = static_cast<std::uint32_t>(start);
+        length.edit(id) = static_cast<std::uint32_t>(n.s.size());
+
+        next.edit(id) = bucket[hash_v];
+        bucket.edit(hash_v) = id;
+
+        if(garbage > 4096 && garbage * 2 > chars.size())
+            compact(e);
+        return id;
+    }
+
+    void erase(std::uint32_t id, Epochs* e)
+    {
+        std::size_t hash_v = Hash()(name(id)) % max_buckets;
+        if(bucket[hash_v] == id)
+            bucket.edit(hash_v) = next[id];
+        else
+        {
+            std::uint32_t p = bucket[hash_v];
+            while(next[p] != id)
+                p = next[p];
+            next.edit(p) = next[id];
+        }
+
+        garbage += length[id];
+        releaseId(id);
+
+        //once most of chars is garbage, squeeze it out
+        if(garbage > 4096 && garbage * 2 > chars.size())
+            compact(e);
+    }
+
+    //reuses an id given up by releaseId if there is one
+    std::uint32_t newId()
+    {
+        std::uint32_t id = freeId;
+        if(id != NIL)
+            freeId = next[id];
+        else
+        {
+            id = static_cast<std::uint32_t>(offset.size());
+            next.push_back(NIL);
+            offset.push_back(NIL);
+            length.push_back(0);
+        }
+        return id;
+    }
+
+    void releaseId(std::uint32_t id)
+    {
+        offset.edit(id) = NIL;
+        length.edit(id) = 0;
+        next.edit(id) = freeId;
+        freeId = id;
+    }
+
+    void compact(Epochs* e)
+    {
+        PagedColumn<char, NAME_PAGE_SHIFT> live(e);
+        garbage = 0;
+        for(std::uint32_t id = 0; id < offset.size(); id++)
+        {
+            if(offset[id] == NIL || offset[id] == NUMBERED)
+                continue;
+            std::size_t end = live.size();
+            std::size_t start = live.appendContiguous(name(id).data(), length[id]);
+            garbage += start - end;
+            offset.edit(id) = static_cast<std::uint32_t>(start);
+        }
+        chars.clear();
+        chars.swap(live);
+    }
+};
+
+// ChatNumberTable finds the ids of users (or chats) that the caller names
+// by number instead.  It takes its ids from a ChatNameTable and gives them
+// back to it, so numbered and named users (or chats) share one id space
+// and every per-id column.  A numbered id's name is empty.
+template <typename Hash>
+struct ChatNumberTable
+{
+    static constexpr std::uint32_t NIL = 0xFFFFFFFF;
+
+    PagedColumn<std::uint32_t> bucket;  // first id in each bucket, made on first use
+    PagedColumn<std::uint32_t> next;    // by id: next id in the same bucket
+    PagedColumn<std::uint64_t> number;  // by id
+
+    ChatNumberTable(Epochs* e) : bucket(e), next(e), number(e) {}
+
+    void reset()
+    {
+        bucket.reuse();
+        next.reuse();
+        number.reuse();
+    }
+
+    //numbers are often sequential, so spread them with a multiplicative hash
+    std::size_t bucketOf(std::uint64_t n) const
+    {
+        return ((n * 0x9E3779B97F4A7C15ULL) >> 32) % bucket.size();
+    }
+
+    std::uint32_t find(std::uint64_t n) const
+    {
+        if(bucket.empty())
+            return NIL;
+        for(std::uint32_t id = bucket[bucketOf(n)]; id != NIL; id = next[id])
+        {
+            if(number[id] == n)
+                return id;
+        }
+        return NIL;
+    }
+
+    std::uint32_t intern(std::uint64_t n, ChatNameTable<Hash>& names)
+    {
+        std::uint32_t id = find(n);
+        if(id != NIL)
+            return id;
+        if(bucket.empty())
+            bucket.assign(names.max_buckets, NIL);
+
+        id = names.newId();
+        names.offset.edit(id) = ChatNameTable<Hash>::NUMBERED;
+        while(id >= next.size())
+        {
+            next.push_back(NIL);
+            number.push_back(0);
+        }
+        std::size_t b = bucketOf(n);
+        number.edit(id) = n;
+        next.edit(id) = bucket[b];
+        bucket.edit(b) = id;
+        return id;
+    }
+
+    void erase(std::uint32_t id, ChatNameTable<Hash>& names)
+    {
+        std::size_t b = bucketOf(number[id]);
+        if(bucket[b] == id)
+            bucket.edit(b) = next[id];
+        else
+        {
+            std::uint32_t p = bucket[b];
+            while(next[p] != id)
+                p = next[p];
+            next.edit(p) = next[id];
+        }
+        names.releaseId(id);
+    }
+};
+
+  // A user or chat given by number rather than by name, for the
+  // BasicChatTracker operations that take one; numbers and names are
+  // separate, so ChatNumber{7} is not the user (or chat) named "7"
+struct ChatNumber
+{
+    std::uint64_t n;
+};
+
+// for integer keys the key is the id, so there is nothing to look up
+template <typename Key>
+struct ChatIdTable
+{
+    static constexpr std::uint32_t NIL = 0xFFFFFFFF;
+    using Arg = Key;
+    using Owned = Key;
+
+    std::size_t count;  // every key below this has been seen
+
+    ChatIdTable(Epochs*) : count(0) {}
+    void generateHash(int) {}
+    void reset() { count = 0; }
+    std::string_view name(std::uint32_t) const { return std::string_view(); }
+    bool isFree(std::uint32_t) const { return false; }
+    Owned owned(std::uint32_t id) const { return Owned(id); }
+    std::size_t bucketOf(Arg k) const { return k; }
+    std::uint32_t find(Arg k) const { return k < count ? static_cast<std::uint32_t>(k) : NIL; }
+
+    //the biggest key that is an id; NIL and the value below it are not
+    static constexpr std::uint64_t MAX_KEY = 0xFFFFFFFD;
+
+    //throws std::out_of_range, before changing anything, for a bigger key
+    std::uint32_t intern(Arg k, Epochs*)
+    {
+        if(static_cast<std::uint64_t>(k) > MAX_KEY)
+            throw std::out_of_range("ChatIdTable: key too big to be an id");
+        if(k >= count)
+            count = std::size_t(k) + 1;
+        return static_cast<std::uint32_t>(k);
+    }
+    void erase(std::uint32_t, Epochs*) {}
+};
+
+
+  // The whole tracker, in a header so that calls on it can be inlined.
+  // ChatTracker is BasicChatTracker<ChatTrackerPolicy> behind a pointer;
+  // see it for what each operation does.  Names are taken as KeyArg, which
+  // for string keys is a std::string_view plus its hash.  Snapshots and
+  // shared regions need ChatTrackerPolicy's layout, and only trackers with
+  // that layout need SharedRegion.cpp linked in.
+template <typename Policy>
+class BasicChatTracker
+{
+public:
+    using Count = typename Policy::Count;
+    using Keys = typename std::conditional<std::is_integral<typename Policy::Key>::value,
+                                           ChatIdTable<typename Policy::Key>,
+                                           ChatNameTable<typename Policy::Hash>>::type;
+    using KeyArg = typename Keys::Arg;
+    using Key = typename Keys::Owned;  // std::string for string keys
+
+    // end of a chain / list, or "no such name"
+    static constexpr std::uint32_t NIL = 0xFFFFFFFF;
+    // stored in m_userPrev once a membership has been left
+    static constexpr std::uint32_t DEPARTED = 0xFFFFFFFE;
+
+    // events carry counts and totals as 64-bit integers, so none is cut short
+    static_assert(std::numeric_limits<Count>::is_integer && std::numeric_limits<Count>::digits <= 63,
+                  "ChatEvent::value cannot hold every Count");
+
+    // the tables ChatSnapshot and ChatTrackerReader know how to read
+    static constexpr bool STANDARD_LAYOUT =
+        std::is_same<Keys, ChatNameTable<std::hash<std::string_view>>>::value &&
+        std::is_same<Count, int>::value && Policy::keepDeparted;
+
+    explicit BasicChatTracker(int maxBuckets = 20000, std::pmr::memory_resource* r = std::pmr::get_default_resource());
+    // every table lives in region, and the tracker owns it (so a tracker
+    // that cannot be built in it still unmaps it)
+    BasicChatTracker(int maxBuckets, std::unique_ptr<SharedRegion> region);
+    void join(KeyArg user, KeyArg chat);
+    Count terminate(KeyArg chat);
+    Count contribute(KeyArg user);
+    Count contribute(KeyArg user, Count n);
+    Count leave(KeyArg user, KeyArg chat);
+    Count leave(KeyArg user);
+    std::vector<Count> terminateMany(const std::vector<Key>& chats);
+    std::vector<std::pair<Key, Count>> leaveAll(KeyArg user);
+    // the named users with a current chat, and taking a user's current
+    // memberships (newest first) out as if they had never been made
+    std::vector<Key> activeUsers() const;
+    std::vector<std::pair<Key, Count>> extractUser(KeyArg user);
+    // the same, for users and chats given by number (string keys only)
+    void join(ChatNumber user, ChatNumber chat);
+    Count terminate(ChatNumber chat);
+    Count contribute(ChatNumber user);
+    Count contribute(ChatNumber user, Count n);
+    Count leave(ChatNumber user, ChatNumber chat);
+    Count leave(ChatNumber user);
+    void setChatExpiry(long long ttl, std::function<void(const Key&, Count)> onExpire, int sweepPerOp);
+    void sweep(int maxChats);
+    void setContributeCache(std::size_t entries);
+    void reset();
+    void setColdStorage(const std::string& path, long long idleOps, int spillPerOp);
+    std::vector<std::pair<Key, Count>> coldMemberships(KeyArg chat) const;
+    std::uint64_t coldBytes() const { return m_cold ? m_cold->size() : 0; }
+    std::uint64_t coldOrphanedBytes() const { return m_cold ? m_cold->orphaned() : 0; }
+    void compactCold();
+    std::shared_ptr<const ChatSnapshotState> snapshot();
+    void enableEvents(std::size_t capacity, ChatEventFeed::Overflow overflow);
+    void disableEvents();
+    std::size_t drainEvents(ChatEvent* out, std::size_t max);
+    std::uint64_t droppedEvents() const;
+    std::string_view userName(std::uint32_t id) const;
+    std::string_view chatName(std::uint32_t id) const;
+
+    // read-only queries.  A membership is given by its slot, and the lists
+    // that chatsOf and members start end with NIL; what they lead to
+    // stays valid until the tracker next changes.
+    struct MemberView
+    {
+        std::uint32_t user;
+        std::uint32_t chat;
+        Count count;
+        bool current;  // false once the user has left the chat
+    };
+    Count contribution(KeyArg user, KeyArg chat) const;
+    std::uint32_t chatsOf(KeyArg user) const;  // current chat first
+    std::uint32_t nextChatOf(std::uint32_t m) const { return liveFrom(m_userNext[m]); }
+    std::uint32_t members(KeyArg chat) const;
+    std::uint32_t nextMember(std::uint32_t m) const { return skipTotals(m_chatNext[m]); }
+    MemberView member(std::uint32_t m) const
+    {
+        return MemberView{ m_user[m], m_chat[m], countOf(m), m_userPrev[m] != DEPARTED };
+    }
+    ~BasicChatTracker();
+
+    BasicChatTracker(const BasicChatTracker&) = delete;
+    BasicChatTracker& operator=(const BasicChatTracker&) = delete;
+
+private:
+    // stands in for the region when the tables can't be shared, so that
+    // such trackers need nothing from SharedRegion.cpp
+    struct NoRegion
+    {
+        explicit operator bool() const { return false; }
+        void reset(SharedRegion*) {}
+    };
+
+    // deletes an object that make() built from the tracker's resource
+    struct Destroy
+    {
+        std::pmr::memory_resource* resource;
+        template <typename T>
+        void operator()(T* p) const
+        {
+            p->~T();
+            resource->deallocate(p, sizeof(T), alignof(T));
+        }
+    };
+
+    template <typename T, typename... Args>
+    std::unique_ptr<T, Destroy> make(Args&&... args)
+    {
+        std::pmr::memory_resource* r = m_epochs.resource();
+        void* p = r->allocate(sizeof(T), alignof(T));
+        try
+        {
+            return std::unique_ptr<T, Destroy>(new (p) T(std::forward<Args>(args)...), Destroy{ r });
+        }
+        catch(...)
+        {
+            r->deallocate(p, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+
+    // declared first so that it outlives every table allocated from it
+    typename std::conditional<STANDARD_LAYOUT, std::unique_ptr<SharedRegion>, NoRegion>::type m_region;
+    Epochs m_epochs;
+
+    Keys m_users;
+    Keys m_chats;
+
+    // ids of users and chats given by number; integer keys are ids already
+    static constexpr bool HAS_NUMBERS = !std::is_integral<typename Policy::Key>::value;
+    struct NoNumbers
+    {
+        NoNumbers(Epochs*) {}
+        void reset() {}
+    };
+    using Numbers = typename std::conditional<HAS_NUMBERS, ChatNumberTable<typename Policy::Hash>, NoNumbers>::type;
+    Numbers m_userNumbers;
+    Numbers m_chatNumbers;
+
+    // one entry per user id / chat id
+    PagedColumn<std::uint32_t> m_userHead;  // the user's current membership (newest first)
+    PagedColumn<std::uint32_t> m_chatHead;  // every membership of the chat, current or departed
+
+    // a user's id (and name) is given up once no membership slot holds it,
+    // current, departed or dead, unless an event not yet drained names it
+    PagedColumn<std::uint32_t> m_userSlots;     // slots whose m_user is the user
+    PagedColumn<std::uint64_t> m_userEventSeq;  // 1 + sequence number of the newest event naming the user, or 0
+    std::pmr::vector<std::uint32_t> m_pendingUsers;  // user ids waiting for their events to be drained
+    std::size_t m_pendingUsersFirst;
+
+    // membership columns, all indexed by membership number
+    PagedColumn<std::uint32_t> m_user;      // NIL for a free slot or a chat's moved total
+    PagedColumn<std::uint32_t> m_chat;
+    PagedColumn<Count> m_count;
+    PagedColumn<std::uint32_t> m_userNext;  // next (older) current membership of the user
+    PagedColumn<std::uint32_t> m_userPrev;  // previous (newer) current membership of the user, or DEPARTED
+    PagedColumn<std::uint32_t> m_chatNext;  // next membership of the same chat, or next free slot
+    PagedColumn<std::uint32_t> m_gen;       // the chat's generation when the membership was made
+    std::uint32_t m_free;
+
+    // a chat's list is doubly linked, so that a membership can be taken out
+    // of it (by extractUser, or without keepDeparted by leaving) in O(1)
+    PagedColumn<std::uint32_t> m_chatPrev;  // previous membership of the same chat
+    PagedColumn<std::uint32_t> m_chatTail;  // one entry per chat id: the last membership in its list
+
+    // without keepDeparted, a chat's list holds only its current memberships;
+    // this stays empty otherwise
+    struct Departed
+    {
+        std::uint32_t members;  // how many departed members there were
+    };
+    PagedColumn<Departed> m_chatDeparted;   // one entry per chat id
+
+    // idle-chat expiry; the clock counts operations, and expiry is off while m_ttl is 0
+    std::uint64_t m_clock;
+    std::uint64_t m_ttl;
+    int m_sweepPerOp;
+    std::uint32_t m_sweepCursor;  // next chat id sweep() looks at
+    std::function<void(const Key&, Count)> m_onExpire;
+    PagedColumn<std::uint64_t> m_chatLastActive;  // one entry per chat id
+
+    // the event feed, or null while it is off; a terminated chat keeps its
+    // id (and name) until its Terminate event has been drained, so that the
+    // consumer can still look the name up
+    std::unique_ptr<ChatEventFeed, Destroy> m_feed;
+    PagedColumn<std::uint64_t> m_chatReleaseSeq;  // 1 + sequence number of the event that releases the id, or 0
+    std::pmr::vector<std::uint32_t> m_pendingChats;   // chat ids waiting to be released, oldest first
+    std::size_t m_pendingFirst;
+
+    // write-combining: contributes to a user's current membership add up
+    // in a small cache, direct mapped by user id, until the next operation
+    // that is not a cached contribute.  An entry is in use only while its
+    // slot is listed in m_combinedSlots, so no other operation has to look
+    // at the cache.
+    struct Combined
+    {
+        std::uint32_t user;  // NIL for an unused entry
+        std::uint32_t m;     // the user's current membership
+        Count pending;       // not yet added to m_count[m]
+    };
+    std::pmr::vector<Combined> m_combined;  // empty while the cache is off
+    std::pmr::vector<std::uint32_t> m_combinedSlots;
+
+    // tiered storage, off while m_cold is null: departed memberships are
+    // moved, a chat at a time, to a run in the cold file.  A chat's runs
+    // are chained newest first, and in memory the chat keeps one departed
+    // slot with no user whose count is their total, so everything that
+    // adds up a chat's list still gets the same answer.  A membership is
+    // moved to the end of its chat's list when it departs, so the ones
+    // still to be spilled are always the last m_chatHotDeparted of it.
+    struct ColdRun
+    {
+        std::uint64_t prev;     // 1 + offset of the chat's previous run, or 0
+        std::uint32_t records;  // ColdRecords that follow
+        std::uint32_t bytes;    // that they take, names included
+    };
+    // a user's id may be given to someone else once the user's memberships
+    // are spilled, so a record keeps the user's name, which follows it (for
+    // integer keys, the id is the key and there is no name)
+    struct ColdRecord
+    {
+        Count count;
+        std::uint32_t user;  // the length of the name, or for integer keys the id
+    };
+    // how many departed memberships a chat that is not idle collects before they move
+    static const std::uint32_t COLD_RUN = 16;
+    std::unique_ptr<ChatColdFile, Destroy> m_cold;
+    std::uint64_t m_coldIdle;
+    int m_spillPerOp;
+    std::uint32_t m_spillCursor;  // next chat id spillSome() looks at
+    std::pmr::vector<char> m_coldBuffer;
+    PagedColumn<std::uint64_t> m_chatColdRun;      // 1 + offset of the chat's newest run, or 0
+    PagedColumn<std::uint32_t> m_chatColdSlot;     // the slot with the moved total, or NIL
+    PagedColumn<std::uint32_t> m_chatHotDeparted;  // departed memberships still in memory
+    PagedColumn<std::uint64_t> m_chatColdBytes;    // bytes of the file the chat's runs take
+
+    // deferred reclamation: terminate only moves the chat's list here and
+    // bumps the chat's generation, which makes every membership in it dead
+    // at once.  Dead memberships may stay in their users' lists, where they
+    // are skipped, until tick() frees them, RECLAIM_STEP slots at a time.
+    PagedColumn<std::uint32_t> m_chatGen;    // one entry per chat id; never goes back
+    PagedColumn<Count> m_chatTotal;          // what terminate would return, one entry per chat id
+    std::pmr::vector<std::uint32_t> m_retired;  // the rest of each terminated chat's list
+    static const int RECLAIM_STEP = 64;
+
+    //called at the start of every operation
+    void tick()
+    {
+        if(!m_combinedSlots.empty())
+            flushCombined();
+        m_clock++;
+        m_epochs.reclaim();
+        if(m_pendingFirst < m_pendingChats.size())
+            releaseChats(false);
+        if(m_pendingUsersFirst < m_pendingUsers.size())
+            releaseUsers(false);
+        if(m_ttl != 0)
+            sweepSome(m_sweepPerOp);
+        if(m_cold)
+            spillSome(m_spillPerOp);
+        if(!m_retired.empty())
+            reclaimSome(RECLAIM_STEP);
+    }
+
+    //a chat id is in use exactly when the chat has memberships
+    //(or, without keepDeparted, had some that were left)
+    bool chatInUse(std::uint32_t c) const
+    {
+        if constexpr(!Policy::keepDeparted)
+            return m_chatHead[c] != NIL || m_chatDeparted[c].members != 0;
+        return m_chatHead[c] != NIL;
+    }
+
+    void emit(ChatEvent::Op op, std::uint32_t user, std::uint32_t chat, Count value)
+    {
+        if(m_feed)
+        {
+            long long seq = m_feed->push(op, user, chat, value);
+            if(seq >= 0)
+                m_userEventSeq.edit(user) = static_cast<std::uint64_t>(seq) + 1;
+        }
+    }
+
+    // every operation that changes the tables holds one of these, so that
+    // readers of a shared region never see an operation half done
+    struct WriteSection
+    {
+        WriteSection(BasicChatTracker& t) : ct(t)
+        {
+            if constexpr(STANDARD_LAYOUT)
+            {
+                if(ct.m_region)
+                    ct.m_region->beginWrite();
+            }
+        }
+        ~WriteSection()
+        {
+            if constexpr(STANDARD_LAYOUT)
+            {
+                if(ct.m_region)
+                {
+                    ct.publish();
+                    ct.m_region->endWrite();
+                }
+            }
+        }
+        BasicChatTracker& ct;
+    };
+
+    void publish();
+
+    //a membership's count, with any contributes still in the cache
+    Count countOf(std::uint32_t m) const
+    {
+        Count count = m_count[m];
+        if(!m_combinedSlots.empty())
+        {
+            const Combined& e = m_combined[m_user[m] & (m_combined.size() - 1)];
+            if(e.user == m_user[m] && e.m == m)
+                count += e.pending;
+        }
+        return count;
+    }
+
+    //false once the membership's chat has been terminated
+    bool live(std::uint32_t m) const { return m_gen[m] == m_chatGen[m_chat[m]]; }
+
+    //skips the dead memberships in a user's list
+    std::uint32_t liveFrom(std::uint32_t m) const
+    {
+        while(m != NIL && !live(m))
+            m = m_userNext[m];
+        return m;
+    }
+
+    //the user's membership of chat c, or NIL
+    std::uint32_t findMembership(std::uint32_t u, std::uint32_t c) const
+    {
+        std::uint32_t m = m_userHead[u];
+        while(m != NIL && (m_chat[m] != c || !live(m)))
+            m = m_userNext[m];
+        return m;
+    }
+
+    //skips the slot holding a chat's moved total, which has no user
+    std::uint32_t skipTotals(std::uint32_t m) const
+    {
+        while(m != NIL && m_user[m] == NIL)
+            m = m_chatNext[m];
+        return m;
+    }
+
+    std::uint32_t internUser(KeyArg user);
+    std::uint32_t internChat(KeyArg chat);
+    std::uint32_t internUser(ChatNumber user);
+    std::uint32_t internChat(ChatNumber chat);
+    std::uint32_t findUser(KeyArg user) const { return m_users.find(user); }
+    std::uint32_t findChat(KeyArg chat) const { return m_chats.find(chat); }
+    std::uint32_t findUser(ChatNumber user) const { return m_userNumbers.find(user.n); }
+    std::uint32_t findChat(ChatNumber chat) const { return m_chatNumbers.find(chat.n); }
+    void grow(std::uint32_t u, std::uint32_t c);
+    void eraseChat(std::uint32_t c);
+    void eraseUser(std::uint32_t u);
+    void releaseUser(std::uint32_t u);
+    void freeSlot(std::uint32_t m);
+    void joinIds(std::uint32_t u, std::uint32_t c);
+    Count leaveIds(std::uint32_t u);
+    Count leaveIds(std::uint32_t u, std::uint32_t c);
+    Count contributeId(std::uint32_t u, Count n);
+    Count combine(std::uint32_t u, Count n);
+    void flushCombined();
+    Count terminateId(std::uint32_t c);
+    std::uint32_t newMembership(std::uint32_t user, std::uint32_t chat);
+    void unlinkFromUser(std::uint32_t m);
+    void pushFrontOfUser(std::uint32_t m);
+    void unlinkFromChat(std::uint32_t m);
+    void appendToChat(std::uint32_t m);
+    void dropFromChat(std::uint32_t m);
+    Count depart(std::uint32_t m);
+    void removeMembership(std::uint32_t m);
+    Count terminateChat(std::uint32_t c, ChatEvent::Op op);
+    void releaseChats(bool all);
+    void releaseUsers(bool all);
+    void reclaimSome(int maxSlots);
+    void sweepSome(int maxChats);
+    void spillSome(int maxChats);
+    void spillChat(std::uint32_t c);
+};
+
+
+/* ================================================================= */
+/* membership helpers */
+
+//these give a name (or number) an id, growing the per-id columns to cover it
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::internUser(KeyArg user)
+{
+    std::uint32_t u = m_users.intern(user, &m_epochs);
+    grow(u, NIL);
+    return u;
+}
+
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::internChat(KeyArg chat)
+{
+    std::uint32_t c = m_chats.intern(chat, &m_epochs);
+    grow(NIL, c);
+    return c;
+}
+
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::internUser(ChatNumber user)
+{
+    static_assert(HAS_NUMBERS, "integer-keyed trackers take their ids directly");
+    std::uint32_t u = m_userNumbers.intern(user.n, m_users);
+    grow(u, NIL);
+    return u;
+}
+
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::internChat(ChatNumber chat)
+{
+    static_assert(HAS_NUMBERS, "integer-keyed trackers take their ids directly");
+    std::uint32_t c = m_chatNumbers.intern(chat.n, m_chats);
+    grow(NIL, c);
+    return c;
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::grow(std::uint32_t u, std::uint32_t c)
+{
+    while(u != NIL && u >= m_userHead.size())
+    {
+        m_userHead.push_back(NIL);
+        m_userSlots.push_back(0);
+        m_userEventSeq.push_back(0);
+    }
+    while(c != NIL && c >= m_chatHead.size())
+    {
+        m_chatHead.push_back(NIL);
+        m_chatTail.push_back(NIL);
+        m_chatLastActive.push_back(0);
+        m_chatReleaseSeq.push_back(0);
+        m_chatColdRun.push_back(0);
+        m_chatColdSlot.push_back(NIL);
+        m_chatHotDeparted.push_back(0);
+        m_chatColdBytes.push_back(0);
+        m_chatGen.push_back(0);
+        m_chatTotal.push_back(0);
+        if constexpr(!Policy::keepDeparted)
+            m_chatDeparted.push_back(Departed{ 0 });
+    }
+}
+
+//a chat's id goes back to whichever table gave it out
+template <typename Policy>
+void BasicChatTracker<Policy>::eraseChat(std::uint32_t c)
+{
+    if constexpr(HAS_NUMBERS)
+    {
+        if(m_chats.offset[c] == Keys::NUMBERED)
+        {
+            m_chatNumbers.erase(c, m_chats);
+            return;
+        }
+    }
+    m_chats.erase(c, &m_epochs);
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::eraseUser(std::uint32_t u)
+{
+    m_userEventSeq.edit(u) = 0;
+    if constexpr(HAS_NUMBERS)
+    {
+        if(m_users.offset[u] == Keys::NUMBERED)
+        {
+            m_userNumbers.erase(u, m_users);
+            return;
+        }
+    }
+    m_users.erase(u, &m_epochs);
+}
+
+//called once no slot holds user u; the id waits if an event not yet drained names it
+template <typename Policy>
+void BasicChatTracker<Policy>::releaseUser(std::uint32_t u)
+{
+    std::uint64_t seq = m_userEventSeq[u];
+    if(m_feed && seq != 0 && seq - 1 >= m_feed->consumed())
+        m_pendingUsers.push_back(u);
+    else
+        eraseUser(u);
+}
+
+//puts membership slot m on the free list, and gives up its user's id if
+//that was the last slot holding it
+template <typename Policy>
+void BasicChatTracker<Policy>::freeSlot(std::uint32_t m)
+{
+    std::uint32_t u = m_user[m];
+    m_user.edit(m) = NIL;
+    m_chatNext.edit(m) = m_free;
+    m_free = m;
+    if(u != NIL && --m_userSlots.edit(u) == 0)
+        releaseUser(u);
+}
+
+//this function takes a free membership slot (or appends one) for user in chat,
+//and puts it at the front of the chat's list; the caller links it into the user's list
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::newMembership(std::uint32_t user, std::uint32_t chat)
+{
+    std::uint32_t m = m_free;
+    if(m != NIL)
+    {
+        m_free = m_chatNext[m];
+        m_user.edit(m) = user;
+        m_chat.edit(m) = chat;
+        m_count.edit(m) = 0;
+        m_gen.edit(m) = m_chatGen[chat];
+    }
+    else
+    {
+        m = static_cast<std::uint32_t>(m_user.size());
+        m_user.push_back(user);
+        m_chat.push_back(chat);
+        m_count.push_back(0);
+        m_userNext.push_back(NIL);
+        m_userPrev.push_back(NIL);
+        m_chatNext.push_back(NIL);
+        m_gen.push_back(m_chatGen[chat]);
+        m_chatPrev.push_back(NIL);
+    }
+    if(user != NIL)
+        m_userSlots.edit(user)++;
+    std::uint32_t head = m_chatHead[chat];
+    m_chatNext.edit(m) = head;
+    m_chatPrev.edit(m) = NIL;
+    if(head != NIL)
+        m_chatPrev.edit(head) = m;
+    else
+        m_chatTail.edit(chat) = m;
+    m_chatHead.edit(chat) = m;
+    return m;
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::unlinkFromUser(std::uint32_t m)
+{
+    std::uint32_t n = m_userNext[m];
+    std::uint32_t p = m_userPrev[m];
+    if(p == NIL)
+        m_userHead.edit(m_user[m]) = n;
+    else
+        m_userNext.edit(p) = n;
+    if(n != NIL)
+        m_userPrev.edit(n) = p;
+}
+
+//the front of a user's list is the user's current chat
+template <typename Policy>
+void BasicChatTracker<Policy>::pushFrontOfUser(std::uint32_t m)
+{
+    std::uint32_t u = m_user[m];
+    std::uint32_t head = m_userHead[u];
+    m_userNext.edit(m) = head;
+    m_userPrev.edit(m) = NIL;
+    if(head != NIL)
+        m_userPrev.edit(head) = m;
+    m_userHead.edit(u) = m;
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::unlinkFromChat(std::uint32_t m)
+{
+    std::uint32_t c = m_chat[m];
+    std::uint32_t n = m_chatNext[m];
+    std::uint32_t p = m_chatPrev[m];
+    if(p == NIL)
+        m_chatHead.edit(c) = n;
+    else
+        m_chatNext.edit(p) = n;
+    if(n == NIL)
+        m_chatTail.edit(c) = p;
+    else
+        m_chatPrev.edit(n) = p;
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::appendToChat(std::uint32_t m)
+{
+    std::uint32_t c = m_chat[m];
+    std::uint32_t tail = m_chatTail[c];
+    m_chatNext.edit(m) = NIL;
+    m_chatPrev.edit(m) = tail;
+    if(tail == NIL)
+        m_chatHead.edit(c) = m;
+    else
+        m_chatNext.edit(tail) = m;
+    m_chatTail.edit(c) = m;
+}
+
+//without keepDeparted, a membership that has been left is only counted (its
+//contribution is already in the chat's total) and its slot freed at once;
+//with cold storage, it goes to the end of its chat's list to wait for spillChat
+template <typename Policy>
+void BasicChatTracker<Policy>::dropFromChat(std::uint32_t m)
+{
+    if constexpr(!Policy::keepDeparted)
+    {
+        m_chatDeparted.edit(m_chat[m]).members++;
+        unlinkFromChat(m);
+        freeSlot(m);
+    }
+    else if(m_cold)
+    {
+        m_chatHotDeparted.edit(m_chat[m])++;
+        unlinkFromChat(m);
+        appendToChat(m);
+    }
+}
+
+//a departed membership stays in its chat's list (terminate still counts it)
+//but is no longer in its user's list
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::depart(std::uint32_t m)
+{
+    unlinkFromUser(m);
+    m_userNext.edit(m) = NIL;
+    m_userPrev.edit(m) = DEPARTED;
+    Count count = m_count[m];
+    dropFromChat(m);
+    return count;
+}
+
+
+template <typename Policy>
+BasicChatTracker<Policy>::BasicChatTracker(int maxBuckts, std::pmr::memory_resource* r)
+ : m_epochs(r),
+   m_users(&m_epochs), m_chats(&m_epochs), m_userNumbers(&m_epochs), m_chatNumbers(&m_epochs),
+   m_userHead(&m_epochs), m_chatHead(&m_epochs),
+   m_userSlots(&m_epochs), m_userEventSeq(&m_epochs), m_pendingUsers(m_epochs.resource()), m_pendingUsersFirst(0),
+   m_user(&m_epochs), m_chat(&m_epochs), m_count(&m_epochs),
+   m_userNext(&m_epochs), m_userPrev(&m_epochs), m_chatNext(&m_epochs), m_gen(&m_epochs),
+   m_free(NIL), m_chatPrev(&m_epochs), m_chatTail(&m_epochs), m_chatDeparted(&m_epochs),
+   m_clock(0), m_ttl(0), m_sweepPerOp(0), m_sweepCursor(0),
+   m_chatLastActive(&m_epochs),
+   m_feed(nullptr, Destroy{ r }),
+   m_chatReleaseSeq(&m_epochs), m_pendingChats(m_epochs.resource()), m_pendingFirst(0),
+   m_combined(m_epochs.resource()), m_combinedSlots(m_epochs.resource()),
+   m_cold(nullptr, Destroy{ r }), m_coldIdle(0), m_spillPerOp(0), m_spillCursor(0), m_coldBuffer(r),
+   m_chatColdRun(&m_epochs), m_chatColdSlot(&m_epochs), m_chatHotDeparted(&m_epochs), m_chatColdBytes(&m_epochs),
+   m_chatGen(&m_epochs), m_chatTotal(&m_epochs), m_retired(m_epochs.resource())
+{
+    m_users.generateHash(maxBuckts);
+    m_chats.generateHash(maxBuckts);
+}
+
+template <typename Policy>
+BasicChatTracker<Policy>::BasicChatTracker(int maxBuckts, std::unique_ptr<SharedRegion> region)
+ : BasicChatTracker(maxBuckts, static_cast<std::pmr::memory_resource*>(region.get()))
+{
+    static_assert(STANDARD_LAYOUT, "only ChatTrackerPolicy's tables can be shared");
+    m_region.reset(region.release());
+    WriteSection ws(*this);
+}
+
+
+//tells readers of the shared region where every table is now
+template <typename Policy>
+void BasicChatTracker<Policy>::publish()
+{
+    if constexpr(STANDARD_LAYOUT)
+    {
+        const Keys* tables[2] = { &m_users, &m_chats };
+        for(int k = 0; k < 2; k++)
+        {
+            const Keys& t = *tables[k];
+            int first = (k == 0 ? UserBucket : ChatBucket);
+            m_region->publish(SharedArray(first), t.bucket.slots(), t.bucket.size(), 12);
+            m_region->publish(SharedArray(first + 1), t.next.slots(), t.next.size(), 12);
+            m_region->publish(SharedArray(first + 2), t.offset.slots(), t.offset.size(), 12);
+            m_region->publish(SharedArray(first + 3), t.length.slots(), t.length.size(), 12);
+            m_region->publish(SharedArray(first + 4), t.chars.slots(), t.chars.size(), NAME_PAGE_SHIFT);
+        }
+        m_region->publish(UserHead, m_userHead.slots(), m_userHead.size(), 12);
+        m_region->publish(ChatHead, m_chatHead.slots(), m_chatHead.size(), 12);
+        m_region->publish(MemberUser, m_user.slots(), m_user.size(), 12);
+        m_region->publish(MemberChat, m_chat.slots(), m_chat.size(), 12);
+        m_region->publish(MemberCount, m_count.slots(), m_count.size(), 12);
+        m_region->publish(MemberUserNext, m_userNext.slots(), m_userNext.size(), 12);
+        m_region->publish(MemberUserPrev, m_userPrev.slots(), m_userPrev.size(), 12);
+        m_region->publish(MemberChatNext, m_chatNext.slots(), m_chatNext.size(), 12);
+        m_region->publish(ChatLastActive, m_chatLastActive.slots(), m_chatLastActive.size(), 12);
+        m_region->publish(MemberGeneration, m_gen.slots(), m_gen.size(), 12);
+        m_region->publish(ChatGeneration, m_chatGen.slots(), m_chatGen.size(), 12);
+    }
+}
+
+
+
+/* ================================================================= */
+/* join(user, chat) implementation */
+
+template <typename Policy>
+void BasicChatTracker<Policy>::join(KeyArg user, KeyArg chat)
+{
+    WriteSection ws(*this);
+    tick();
+    std::uint32_t u = internUser(user);
+    std::uint32_t c;
+    try
+    {
+        c = internChat(chat);
+    }
+    catch(...)
+    {
+        //a user new to the tracker has no slot yet to hold its id
+        if(m_userSlots[u] == 0)
+            releaseUser(u);
+        throw;
+    }
+    joinIds(u, c);
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::join(ChatNumber user, ChatNumber chat)
+{
+    WriteSection ws(*this);
+    tick();
+    std::uint32_t u = internUser(user);
+    joinIds(u, internChat(chat));
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::joinIds(std::uint32_t u, std::uint32_t c)
+{
+    //check if the user has joined this chat or not
+    //if so, change the chat to the user's current chat
+    //if not,
+        //let the user join the chat, and the chat is the user's current chat
+
+    m_chatLastActive.edit(c) = m_clock;
+
+    std::uint32_t m = findMembership(u, c);
+
+    //if the user has already joined the chat
+    if(m != NIL)
+    {
+        //if it is already the current chat, do nothing
+        if(m == liveFrom(m_userHead[u]))
+            return;
+        unlinkFromUser(m);
+    }
+
+    // m == NIL: the user has not joined the chat
+    else
+        m = newMembership(u, c);
+
+    pushFrontOfUser(m);
+    emit(ChatEvent::Join, u, c, m_count[m]);
+}
+
+
+/* ================================================================= */
+/* leave(user) implementation */
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leave(KeyArg user)
+{
+    WriteSection ws(*this);
+    tick();
+    return leaveIds(findUser(user));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leave(ChatNumber user)
+{
+    WriteSection ws(*this);
+    tick();
+    return leaveIds(findUser(user));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leaveIds(std::uint32_t u)
+{
+    if(u == NIL)
+        return -1;
+
+    std::uint32_t m = liveFrom(m_userHead[u]);
+    //the user is not associated with any chat
+    if(m == NIL)
+        return -1;
+
+    m_chatLastActive.edit(m_chat[m]) = m_clock;
+    emit(ChatEvent::Leave, u, m_chat[m], m_count[m]);
+    return depart(m);
+}
+
+/* ================================================================= */
+/* leave(user, chat) implementation */
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leave(KeyArg user, KeyArg chat)
+{
+    WriteSection ws(*this);
+    tick();
+    return leaveIds(findUser(user), findChat(chat));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leave(ChatNumber user, ChatNumber chat)
+{
+    WriteSection ws(*this);
+    tick();
+    return leaveIds(findUser(user), findChat(chat));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::leaveIds(std::uint32_t u, std::uint32_t c)
+{
+    if(u == NIL || c == NIL)
+        return -1;
+
+    std::uint32_t m = findMembership(u, c);
+
+    // if the user is not associated with the chat indicated
+    if(m == NIL)
+        return -1;
+
+    m_chatLastActive.edit(c) = m_clock;
+    emit(ChatEvent::Leave, u, c, m_count[m]);
+    return depart(m);
+}
+
+
+
+/* ================================================================= */
+/* contribute(user) implementation */
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contribute(KeyArg user)
+{
+    return contribute(user, 1);
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contribute(KeyArg user, Count n)
+{
+    if(!m_combined.empty())
+        return combine(findUser(user), n);
+    WriteSection ws(*this);
+    tick();
+    return contributeId(findUser(user), n);
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contribute(ChatNumber user)
+{
+    return contribute(user, 1);
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contribute(ChatNumber user, Count n)
+{
+    if(!m_combined.empty())
+        return combine(findUser(user), n);
+    WriteSection ws(*this);
+    tick();
+    return contributeId(findUser(user), n);
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contributeId(std::uint32_t u, Count n)
+{
+    if(u == NIL)
+        return 0;
+
+    std::uint32_t m = liveFrom(m_userHead[u]);
+    //if the user is not associated with any chat
+    if(m == NIL)
+        return 0;
+
+    m_chatLastActive.edit(m_chat[m]) = m_clock;
+    m_chatTotal.edit(m_chat[m]) += n;
+    Count count = (m_count.edit(m) += n);
+    emit(ChatEvent::Contribute, u, m_chat[m], count);
+    return count;
+}
+
+//a cached contribute only adds to the user's cache entry; the result is
+//still exact, because whatever could change the membership flushes first
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::combine(std::uint32_t u, Count n)
+{
+    if(u == NIL)
+        return 0;
+
+    std::uint32_t slot = u & static_cast<std::uint32_t>(m_combined.size() - 1);
+    Combined& e = m_combined[slot];
+    if(e.user != u)
+    {
+        //the entry belongs to another user, so add up what it has
+        if(e.user != NIL)
+        {
+            WriteSection ws(*this);
+            flushCombined();
+        }
+        std::uint32_t m = liveFrom(m_userHead[u]);
+        if(m == NIL)
+            return 0;
+        e.user = u;
+        e.m = m;
+        e.pending = 0;
+        m_combinedSlots.push_back(slot);
+    }
+    e.pending += n;
+    return m_count[e.m] + e.pending;
+}
+
+//adds every cache entry into its membership and empties the cache; it runs
+//at the start of every other operation, so a run of cached contributes
+//counts as one operation for expiry and is one Contribute event
+template <typename Policy>
+void BasicChatTracker<Policy>::flushCombined()
+{
+    for(std::size_t k = 0; k < m_combinedSlots.size(); k++)
+    {
+        Combined& e = m_combined[m_combinedSlots[k]];
+        std::uint32_t c = m_chat[e.m];
+        m_chatLastActive.edit(c) = m_clock;
+        m_chatTotal.edit(c) += e.pending;
+        Count count = (m_count.edit(e.m) += e.pending);
+        emit(ChatEvent::Contribute, e.user, c, count);
+        e.user = NIL;
+    }
+    m_combinedSlots.clear();
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::setContributeCache(std::size_t entries)
+{
+    WriteSection ws(*this);
+    flushCombined();
+    std::size_t n = 0;
+    if(entries != 0)
+    {
+        n = 1;
+        while(n < entries)
+            n *= 2;
+    }
+    m_combined.assign(n, Combined{ NIL, NIL, 0 });
+}
+
+
+/* ================================================================= */
+/* terminate(chat) implementation */
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::terminate(KeyArg chat)
+{
+    WriteSection ws(*this);
+    tick();
+    return terminateId(findChat(chat));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::terminate(ChatNumber chat)
+{
+    WriteSection ws(*this);
+    tick();
+    return terminateId(findChat(chat));
+}
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::terminateId(std::uint32_t c)
+{
+    // the chat does not exist (or is terminated, and only waiting for
+    // its id to be released)
+    if(c == NIL || !chatInUse(c))
+        return 0;
+
+    return terminateChat(c, ChatEvent::Terminate);
+}
+
+//this function retires chat c and gives up its id, in the same time however
+//many members it has: bumping the generation makes its memberships dead, and
+//reclaimSome frees them later.  It is used by terminate, terminateMany and expiry
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::terminateChat(std::uint32_t c, ChatEvent::Op op)
+{
+    Count total = m_chatTotal[c];
+    m_chatTotal.edit(c) = 0;
+    if constexpr(!Policy::keepDeparted)
+        m_chatDeparted.edit(c) = Departed{ 0 };
+    m_chatGen.edit(c)++;
+
+    //a join to the same chat from now on starts a new list
+    if(m_chatHead[c] != NIL)
+    {
+        m_retired.push_back(m_chatHead[c]);
+        m_chatHead.edit(c) = NIL;
+        m_chatTail.edit(c) = NIL;
+    }
+
+    if(m_cold)
+    {
+        //the chat's runs stay in the file until it is compacted, but
+        //nothing leads to them now
+        m_cold->orphan(m_chatColdBytes[c]);
+        m_chatColdBytes.edit(c) = 0;
+        m_chatColdRun.edit(c) = 0;
+        m_chatColdSlot.edit(c) = NIL;
+        m_chatHotDeparted.edit(c) = 0;
+    }
+    long long seq = (m_feed ? m_feed->push(op, ChatEvent::NO_USER, c, total) : -1);
+    if(seq >= 0)
+    {
+        m_chatReleaseSeq.edit(c) = static_cast<std::uint64_t>(seq) + 1;
+        m_pendingChats.push_back(c);
+    }
+    //with no event of its own (the feed is off, or dropped it), the id goes
+    //now, unless an earlier Terminate event not yet drained still holds it
+    else if(m_chatReleaseSeq[c] == 0)
+        eraseChat(c);
+    return total;
+}
+
+//this function gives up the ids of terminated chats whose Terminate events have
+//been drained (or all of them, if all is set), unless they have been joined again
+template <typename Policy>
+void BasicChatTracker<Policy>::releaseChats(bool all)
+{
+    std::uint64_t consumed = (m_feed && !all ? m_feed->consumed() : ~std::uint64_t(0));
+    while(m_pendingFirst < m_pendingChats.size())
+    {
+        std::uint32_t c = m_pendingChats[m_pendingFirst];
+        std::uint64_t seq = m_chatReleaseSeq[c];
+        //the chat may have been terminated again since; its newest event decides
+        if(seq != 0)
+        {
+            if(seq - 1 >= consumed)
+                break;
+            m_chatReleaseSeq.edit(c) = 0;
+            if(!chatInUse(c) && !m_chats.isFree(c))
+                eraseChat(c);
+        }
+        m_pendingFirst++;
+    }
+    //the queue may never empty while events keep coming, so its front is
+    //dropped once it is most of it
+    if(m_pendingFirst * 2 >= m_pendingChats.size())
+    {
+        m_pendingChats.erase(m_pendingChats.begin(), m_pendingChats.begin() + m_pendingFirst);
+        m_pendingFirst = 0;
+    }
+}
+
+//the same for users no slot holds any more, unless they have joined again
+template <typename Policy>
+void BasicChatTracker<Policy>::releaseUsers(bool all)
+{
+    std::uint64_t consumed = (m_feed && !all ? m_feed->consumed() : ~std::uint64_t(0));
+    while(m_pendingUsersFirst < m_pendingUsers.size())
+    {
+        std::uint32_t u = m_pendingUsers[m_pendingUsersFirst];
+        std::uint64_t seq = m_userEventSeq[u];
+        if(seq != 0)
+        {
+            if(seq - 1 >= consumed)
+                break;
+            m_userEventSeq.edit(u) = 0;
+            if(m_userSlots[u] == 0 && !m_users.isFree(u))
+                eraseUser(u);
+        }
+        m_pendingUsersFirst++;
+    }
+    //as with chats, the front goes once it is most of the queue
+    if(m_pendingUsersFirst * 2 >= m_pendingUsers.size())
+    {
+        m_pendingUsers.erase(m_pendingUsers.begin(), m_pendingUsers.begin() + m_pendingUsersFirst);
+        m_pendingUsersFirst = 0;
+    }
+}
+
+
+//frees up to maxSlots memberships of terminated chats, taking each out of
+//its user's list if it is still there
+template <typename Policy>
+void BasicChatTracker<Policy>::reclaimSome(int maxSlots)
+{
+    for(int k = 0; k < maxSlots && !m_retired.empty(); k++)
+    {
+        std::uint32_t m = m_retired.back();
+        std::uint32_t n = m_chatNext[m];
+        if(m_userPrev[m] != DEPARTED)
+            unlinkFromUser(m);
+        freeSlot(m);
+        if(n == NIL)
+            m_retired.pop_back();
+        else
+            m_retired.back() = n;
+    }
+}
+
+
+/* ================================================================= */
+/* terminateMany(vector<string> chats) implementation */
+
+template <typename Policy>
+std::vector<typename BasicChatTracker<Policy>::Count> BasicChatTracker<Policy>::terminateMany(const std::vector<Key>& chats)
+{
+    WriteSection ws(*this);
+    tick();
+
+    //look the chats up bucket by bucket; a stable sort keeps repeated names
+    //in their original order, so only the first of them gets the total
+    std::pmr::vector<KeyArg> args(m_epochs.resource());
+    std::pmr::vector<std::size_t> order(chats.size(), m_epochs.resource());
+    args.reserve(chats.size());
+    for(std::size_t k = 0; k < chats.size(); k++)
+    {
+        args.push_back(KeyArg(chats[k]));
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return m_chats.bucketOf(args[a]) < m_chats.bucketOf(args[b]);
+    });
+
+    std::vector<Count> totals(chats.size(), 0);
+    for(std::size_t k = 0; k < order.size(); k++)
+    {
+        std::size_t i = order[k];
+        std::uint32_t c = m_chats.find(args[i]);
+        if(c != NIL && chatInUse(c))
+            totals[i] = terminateChat(c, ChatEvent::Terminate);
+    }
+    return totals;
+}
+
+
+/* ================================================================= */
+/* leaveAll(string user) implementation */
+
+template <typename Policy>
+std::vector<std::pair<typename BasicChatTracker<Policy>::Key, typename BasicChatTracker<Policy>::Count>>
+BasicChatTracker<Policy>::leaveAll(KeyArg user)
+{
+    WriteSection ws(*this);
+    tick();
+    std::vector<std::pair<Key, Count>> left;
+    std::uint32_t u = m_users.find(user);
+    if(u == NIL)
+        return left;
+
+    //one walk down the user's list, current chat first; the list is
+    //dropped as a whole at the end instead of unlinking each membership
+    std::uint32_t m = m_userHead[u];
+    while(m != NIL)
+    {
+        std::uint32_t temp = m_userNext[m];
+        std::uint32_t c = m_chat[m];
+        m_userNext.edit(m) = NIL;
+        m_userPrev.edit(m) = DEPARTED;
+        //a dead membership is only waiting for reclaimSome
+        if(!live(m))
+        {
+            m = temp;
+            continue;
+        }
+        left.push_back(std::make_pair(m_chats.owned(c), m_count[m]));
+        emit(ChatEvent::Leave, u, c, m_count[m]);
+        m_chatLastActive.edit(c) = m_clock;
+        dropFromChat(m);
+        m = temp;
+    }
+    m_userHead.edit(u) = NIL;
+    return left;
+}
+
+
+/* ================================================================= */
+/* activeUsers() and extractUser(user) implementation */
+
+template <typename Policy>
+std::vector<typename BasicChatTracker<Policy>::Key> BasicChatTracker<Policy>::activeUsers() const
+{
+    std::vector<Key> users;
+    for(std::uint32_t u = 0; u < m_userHead.size(); u++)
+    {
+        if(liveFrom(m_userHead[u]) == NIL)
+            continue;
+        if constexpr(HAS_NUMBERS)
+        {
+            if(m_users.offset[u] == Keys::NUMBERED)
+                continue;
+        }
+        users.push_back(m_users.owned(u));
+    }
+    return users;
+}
+
+template <typename Policy>
+std::vector<std::pair<typename BasicChatTracker<Policy>::Key, typename BasicChatTracker<Policy>::Count>>
+BasicChatTracker<Policy>::extractUser(KeyArg user)
+{
+    WriteSection ws(*this);
+    tick();
+    std::vector<std::pair<Key, Count>> taken;
+    std::uint32_t u = m_users.find(user);
+    if(u == NIL)
+        return taken;
+
+    std::uint32_t m = m_userHead[u];
+    while(m != NIL)
+    {
+        std::uint32_t temp = m_userNext[m];
+        if(live(m))
+        {
+            taken.push_back(std::make_pair(m_chats.owned(m_chat[m]), m_count[m]));
+            removeMembership(m);
+        }
+        else
+        {
+            m_userNext.edit(m) = NIL;
+            m_userPrev.edit(m) = DEPARTED;
+        }
+        m = temp;
+    }
+    m_userHead.edit(u) = NIL;
+    return taken;
+}
+
+//unlike depart, this leaves nothing behind for terminate to count; the
+//chat's id is given up if that was its last membership, unless a Terminate
+//event is still holding it
+template <typename Policy>
+void BasicChatTracker<Policy>::removeMembership(std::uint32_t m)
+{
+    std::uint32_t c = m_chat[m];
+    unlinkFromChat(m);
+    m_chatTotal.edit(c) -= m_count[m];
+    freeSlot(m);
+    if(!chatInUse(c) && m_chatReleaseSeq[c] == 0)
+        eraseChat(c);
+}
+
+
+/* ================================================================= */
+/* idle-chat expiry implementation */
+
+template <typename Policy>
+void BasicChatTracker<Policy>::setChatExpiry(long long ttl, std::function<void(const Key&, Count)> onExpire, int sweepPerOp)
+{
+    m_ttl = (ttl > 0 ? ttl : 0);
+    m_onExpire = onExpire;
+    m_sweepPerOp = sweepPerOp;
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::sweep(int maxChats)
+{
+    WriteSection ws(*this);
+    flushCombined();
+    sweepSome(maxChats);
+}
+
+//looks at the next maxChats chat ids, round robin, and expires the idle ones,
+//so the work done per call is bounded no matter how many chats there are
+template <typename Policy>
+void BasicChatTracker<Policy>::sweepSome(int maxChats)
+{
+    if(m_ttl == 0 || m_chatHead.empty())
+        return;
+
+    for(int k = 0; k < maxChats; k++)
+    {
+        if(m_sweepCursor >= m_chatHead.size())
+            m_sweepCursor = 0;
+        std::uint32_t c = m_sweepCursor++;
+
+        if(!chatInUse(c) || m_clock - m_chatLastActive[c] <= m_ttl)
+            continue;
+
+        if(m_onExpire)
+        {
+            Key name(m_chats.owned(c));
+            Count total = terminateChat(c, ChatEvent::Expire);
+            m_onExpire(name, total);
+        }
+        else
+            terminateChat(c, ChatEvent::Expire);
+    }
+}
+
+
+/* ================================================================= */
+/* tiered storage implementation */
+
+template <typename Policy>
+void BasicChatTracker<Policy>::setColdStorage(const std::string& path, long long idleOps, int spillPerOp)
+{
+    static_assert(Policy::keepDeparted, "without keepDeparted there are no departed memberships to move");
+    m_coldIdle = (idleOps > 0 ? idleOps : 0);
+    m_spillPerOp = spillPerOp;
+    if(m_cold)
+        return;
+    m_cold = make<ChatColdFile>(path, m_epochs.resource());
+
+    //count what is already departed, and gather it at the ends of the lists
+    for(std::uint32_t m = 0; m < m_user.size(); m++)
+    {
+        if(m_user[m] != NIL && m_userPrev[m] == DEPARTED && live(m))
+            dropFromChat(m);
+    }
+}
+
+//looks at the next maxChats chat ids, round robin, and moves the departed
+//memberships of those that have collected enough of them or gone idle
+template <typename Policy>
+void BasicChatTracker<Policy>::spillSome(int maxChats)
+{
+    if(m_chatHead.empty())
+        return;
+
+    for(int k = 0; k < maxChats; k++)
+    {
+        if(m_spillCursor >= m_chatHead.size())
+            m_spillCursor = 0;
+        std::uint32_t c = m_spillCursor++;
+
+        std::uint32_t hot = m_chatHotDeparted[c];
+        if(hot == 0 || (hot < COLD_RUN && m_clock - m_chatLastActive[c] <= m_coldIdle))
+            continue;
+        spillChat(c);
+    }
+}
+
+//writes chat c's departed memberships as one run and frees their slots; they
+//are the last ones in its list, so only they are looked at, newest first
+template <typename Policy>
+void BasicChatTracker<Policy>::spillChat(std::uint32_t c)
+{
+    ColdRun run = { m_chatColdRun[c], 0, 0 };
+    m_coldBuffer.resize(sizeof(run));
+    Count moved = 0;
+
+    std::uint32_t m = m_chatTail[c];
+    for(std::uint32_t k = m_chatHotDeparted[c]; k > 0; k--)
+    {
+        std::uint32_t temp = m_chatPrev[m];
+        std::string_view name = m_users.name(m_user[m]);
+        ColdRecord r = { m_count[m], HAS_NUMBERS ? static_cast<std::uint32_t>(name.size()) : m_user[m] };
+        const char* bytes = reinterpret_cast<const char*>(&r);
+        m_coldBuffer.insert(m_coldBuffer.end(), bytes, bytes + sizeof(r));
+        m_coldBuffer.insert(m_coldBuffer.end(), name.begin(), name.end());
+        run.records++;
+        moved += m_count[m];
+
+        unlinkFromChat(m);
+        freeSlot(m);
+        m = temp;
+    }
+
+    std::uint32_t slot = m_chatColdSlot[c];
+    if(slot == NIL)
+    {
+        slot = newMembership(NIL, c);
+        m_userNext.edit(slot) = NIL;
+        m_userPrev.edit(slot) = DEPARTED;
+        m_chatColdSlot.edit(c) = slot;
+    }
+    m_count.edit(slot) += moved;
+
+    run.bytes = static_cast<std::uint32_t>(m_coldBuffer.size() - sizeof(run));
+    std::memcpy(m_coldBuffer.data(), &run, sizeof(run));
+    std::uint64_t end = m_cold->size();
+    m_chatColdRun.edit(c) = m_cold->append(m_coldBuffer.data(), m_coldBuffer.size()) + 1;
+    m_chatColdBytes.edit(c) += m_cold->size() - end;
+    m_chatHotDeparted.edit(c) = 0;
+}
+
+//copies the runs that chats still lead to into a new file, each chat's
+//oldest first so that their links can be rewritten as they go, and puts
+//it in place of the old one.  This takes time in proportion to the file,
+//so no operation does it on its own; it is the caller's to schedule.
+template <typename Policy>
+void BasicChatTracker<Policy>::compactCold()
+{
+    if(!m_cold || m_cold->orphaned() == 0)
+        return;
+    std::unique_ptr<ChatColdFile, Destroy> fresh =
+        make<ChatColdFile>(std::string(m_cold->path()) + ".compact", m_epochs.resource());
+    std::pmr::vector<std::uint64_t> chain(m_epochs.resource());
+    for(std::uint32_t c = 0; c < m_chatColdRun.size(); c++)
+    {
+        chain.clear();
+        for(std::uint64_t at = m_chatColdRun[c]; at != 0; )
+        {
+            ColdRun run;
+            std::memcpy(&run, m_cold->at(at - 1), sizeof(run));
+            chain.push_back(at - 1);
+            at = run.prev;
+        }
+        if(chain.empty())
+            continue;
+
+        std::uint64_t prev = 0;
+        std::uint64_t end = fresh->size();
+        for(std::size_t k = chain.size(); k > 0; k--)
+        {
+            const char* p = m_cold->at(chain[k - 1]);
+            ColdRun run;
+            std::memcpy(&run, p, sizeof(run));
+            std::size_t bytes = sizeof(run) + run.bytes;
+            m_coldBuffer.assign(p, p + bytes);
+            run.prev = prev;
+            std::memcpy(m_coldBuffer.data(), &run, sizeof(run));
+            prev = fresh->append(m_coldBuffer.data(), bytes) + 1;
+        }
+        m_chatColdRun.edit(c) = prev;
+        m_chatColdBytes.edit(c) = fresh->size() - end;
+    }
+    fresh->rename(std::string(m_cold->path()));
+    m_cold = std::move(fresh);
+}
+
+template <typename Policy>
+std::vector<std::pair<typename BasicChatTracker<Policy>::Key, typename BasicChatTracker<Policy>::Count>>
+BasicChatTracker<Policy>::coldMemberships(KeyArg chat) const
+{
+    std::vector<std::pair<Key, Count>> moved;
+    std::uint32_t c = m_chats.find(chat);
+    if(!m_cold || c == NIL)
+        return moved;
+
+    //each run is read front to back
+    for(std::uint64_t at = m_chatColdRun[c]; at != 0; )
+    {
+        const char* p = m_cold->at(at - 1);
+        ColdRun run;
+        std::memcpy(&run, p, sizeof(run));
+        p += sizeof(run);
+        for(std::uint32_t k = 0; k < run.records; k++)
+        {
+            ColdRecord r;
+            std::memcpy(&r, p, sizeof(r));
+            p += sizeof(r);
+            if constexpr(HAS_NUMBERS)
+            {
+                moved.push_back(std::make_pair(Key(p, r.user), r.count));
+                p += r.user;
+            }
+            else
+                moved.push_back(std::make_pair(m_users.owned(r.user), r.count));
+        }
+        at = run.prev;
+    }
+    return moved;
+}
+
+
+/* ================================================================= */
+/* snapshot() implementation */
+
+//taking a snapshot only records where every column's pages are and starts
+//a new epoch; the writer copies a page the first time it changes it after that
+template <typename Policy>
+std::shared_ptr<const ChatSnapshotState> BasicChatTracker<Policy>::snapshot()
+{
+    static_assert(STANDARD_LAYOUT, "only ChatTrackerPolicy's tables can be snapshot");
+    if(!m_combinedSlots.empty())
+    {
+        WriteSection ws(*this);
+        flushCombined();
+    }
+    Epochs* epochs = &m_epochs;
+    std::shared_ptr<ChatSnapshotState> s(new ChatSnapshotState, [epochs](ChatSnapshotState* p) {
+        delete p;
+        epochs->released();
+    });
+    s->userOffset = m_users.offset.view();
+    s->userLength = m_users.length.view();
+    s->userChars = m_users.chars.view();
+    s->chatBucket = m_chats.bucket.view();
+    s->chatNext = m_chats.next.view();
+    s->chatOffset = m_chats.offset.view();
+    s->chatLength = m_chats.length.view();
+    s->chatChars = m_chats.chars.view();
+    s->chatHead = m_chatHead.view();
+    s->user = m_user.view();
+    s->chat = m_chat.view();
+    s->userPrev = m_userPrev.view();
+    s->chatLink = m_chatNext.view();
+    s->count = m_count.view();
+    s->gen = m_gen.view();
+    s->chatGen = m_chatGen.view();
+    m_epochs.freeze(s);
+    return s;
+}
+
+
+/* ================================================================= */
+/* event feed implementation */
+
+template <typename Policy>
+void BasicChatTracker<Policy>::enableEvents(std::size_t capacity, ChatEventFeed::Overflow overflow)
+{
+    WriteSection ws(*this);
+    flushCombined();
+    releaseChats(true);
+    releaseUsers(true);
+    //sequence numbers from the old feed mean nothing to the new one
+    m_userEventSeq.assign(m_userEventSeq.size(), 0);
+    m_feed = make<ChatEventFeed>(capacity, overflow, m_epochs.resource());
+}
+
+template <typename Policy>
+void BasicChatTracker<Policy>::disableEvents()
+{
+    WriteSection ws(*this);
+    flushCombined();
+    releaseChats(true);
+    releaseUsers(true);
+    //sequence numbers from the old feed mean nothing to the new one
+    m_userEventSeq.assign(m_userEventSeq.size(), 0);
+    m_feed.reset();
+}
+
+template <typename Policy>
+std::size_t BasicChatTracker<Policy>::drainEvents(ChatEvent* out, std::size_t max)
+{
+    return m_feed ? m_feed->drain(out, max) : 0;
+}
+
+template <typename Policy>
+std::uint64_t BasicChatTracker<Policy>::droppedEvents() const
+{
+    return m_feed ? m_feed->dropped() : 0;
+}
+
+template <typename Policy>
+std::string_view BasicChatTracker<Policy>::userName(std::uint32_t id) const
+{
+    return id < m_userHead.size() ? m_users.name(id) : std::string_view();
+}
+
+template <typename Policy>
+std::string_view BasicChatTracker<Policy>::chatName(std::uint32_t id) const
+{
+    return id < m_chatHead.size() ? m_chats.name(id) : std::string_view();
+}
+
+
+/* ================================================================= */
+/* query implementation */
+
+template <typename Policy>
+typename BasicChatTracker<Policy>::Count BasicChatTracker<Policy>::contribution(KeyArg user, KeyArg chat) const
+{
+    std::uint32_t u = m_users.find(user);
+    std::uint32_t c = m_chats.find(chat);
+    if(u == NIL || c == NIL)
+        return -1;
+    std::uint32_t m = findMembership(u, c);
+    return m == NIL ? -1 : countOf(m);
+}
+
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::chatsOf(KeyArg user) const
+{
+    std::uint32_t u = m_users.find(user);
+    return u == NIL ? NIL : liveFrom(m_userHead[u]);
+}
+
+template <typename Policy>
+std::uint32_t BasicChatTracker<Policy>::members(KeyArg chat) const
+{
+    std::uint32_t c = m_chats.find(chat);
+    return c == NIL ? NIL : skipTotals(m_chatHead[c]);
+}
+
+
+/* ================================================================= */
+/* reset() implementation */
+
+//every column keeps its pages, so a reset tracker fills up again without
+//allocating; only the buckets are touched, a page at a time
+template <typename Policy>
+void BasicChatTracker<Policy>::reset()
+{
+    WriteSection ws(*this);
+    m_users.reset();
+    m_chats.reset();
+    m_userNumbers.reset();
+    m_chatNumbers.reset();
+    m_userHead.reuse();
+    m_chatHead.reuse();
+    m_userSlots.reuse();
+    m_userEventSeq.reuse();
+    m_pendingUsers.clear();
+    m_pendingUsersFirst = 0;
+    m_user.reuse();
+    m_chat.reuse();
+    m_count.reuse();
+    m_userNext.reuse();
+    m_userPrev.reuse();
+    m_chatNext.reuse();
+    m_gen.reuse();
+    m_free = NIL;
+    m_chatPrev.reuse();
+    m_chatTail.reuse();
+    m_chatDeparted.reuse();
+    m_clock = 0;
+    m_sweepCursor = 0;
+    m_chatLastActive.reuse();
+    m_chatReleaseSeq.reuse();
+    m_pendingChats.clear();
+    m_pendingFirst = 0;
+    for(std::size_t k = 0; k < m_combinedSlots.size(); k++)
+        m_combined[m_combinedSlots[k]].user = NIL;
+    m_combinedSlots.clear();
+    m_spillCursor = 0;
+    m_chatColdRun.reuse();
+    m_chatColdSlot.reuse();
+    m_chatHotDeparted.reuse();
+    m_chatColdBytes.reuse();
+    m_chatGen.reuse();
+    m_chatTotal.reuse();
+    m_retired.clear();
+    if(m_cold)
+        m_cold->clear();
+}
+
+
+/* ================================================================= */
+/* ~BasicChatTracker() implementation */
+
+template <typename Policy>
+BasicChatTracker<Policy>::~BasicChatTracker()
+{
+    //every column frees its own pages, so there is nothing to walk;
+    //readers of a shared region are told the tracker is now empty
+    if constexpr(STANDARD_LAYOUT)
+    {
+        if(m_region)
+        {
+            m_region->beginWrite();
+            for(int a = 0; a < NumSharedArrays; a++)
+                m_region->publish(SharedArray(a), nullptr, 0, 0);
+            m_region->endWrite();
+        }
+    }
+}
+
+#endif // BASICCHATTRACKER_INCLUDED
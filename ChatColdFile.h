@@ -0,0 +1,122 @@
+#ifndef CHATCOLDFILE_INCLUDED
+#define CHATCOLDFILE_INCLUDED
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+  // An append-only file, memory-mapped, that a tracker moves cold data
+  // into.  Everything in it is found by its offset, so the mapping may
+  // move when the file grows; the file is grown (and remapped) by
+  // doubling, and the pages written go back to the disk through the page
+  // cache.  Nothing in the file outlives the tracker that wrote it.  The
+  // file counts the bytes its writer no longer needs, so the writer can
+  // tell when to copy what it still needs to a new file.
+class ChatColdFile
+{
+  public:
+      // Creates the file at path, or empties it if it exists.  Throws
+      // std::runtime_error if it cannot be made or mapped.
+    ChatColdFile(const std::string& path, std::pmr::memory_resource* r)
+     : m_path(path, r), m_fd(open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)),
+       m_base(nullptr), m_capacity(0), m_size(0), m_orphaned(0)
+    {
+        if (m_fd < 0)
+            fail("cannot create");
+        reserve(INITIAL_BYTES);
+    }
+
+    ~ChatColdFile()
+    {
+        if (m_base != nullptr)
+            munmap(m_base, m_capacity);
+        close(m_fd);
+    }
+
+      // Appends n bytes from p, starting at a multiple of 8, and returns
+      // where they start
+    std::uint64_t append(const void* p, std::size_t n)
+    {
+        std::uint64_t at = (m_size + 7) & ~std::uint64_t(7);
+        if (at + n > m_capacity)
+        {
+            std::size_t c = m_capacity;
+            while (at + n > c)
+                c *= 2;
+            reserve(c);
+        }
+        std::memcpy(m_base + at, p, n);
+        m_size = at + n;
+        return at;
+    }
+
+      // Forgets everything appended, keeping the file's size and mapping
+    void clear()
+    {
+        m_size = 0;
+        m_orphaned = 0;
+    }
+
+      // Notes that n of the bytes appended are no longer needed
+    void orphan(std::uint64_t n) { m_orphaned += n; }
+
+      // Moves the file to path, replacing whatever is there.  Throws
+      // std::runtime_error if it cannot.
+    void rename(const std::string& path)
+    {
+        if (std::rename(m_path.c_str(), path.c_str()) != 0)
+            fail("cannot rename");
+        m_path = path;
+    }
+
+      // Valid until the next append
+    const char* at(std::uint64_t offset) const { return m_base + offset; }
+    std::uint64_t size() const { return m_size; }
+    std::uint64_t orphaned() const { return m_orphaned; }
+    const std::pmr::string& path() const { return m_path; }
+
+    ChatColdFile(const ChatColdFile&) = delete;
+    ChatColdFile& operator=(const ChatColdFile&) = delete;
+
+  private:
+    static const std::size_t INITIAL_BYTES = std::size_t(1) << 20;
+
+    void reserve(std::size_t bytes)
+    {
+        if (ftruncate(m_fd, bytes) != 0)
+            fail("cannot size");
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (p == MAP_FAILED)
+            fail("cannot map");
+        if (m_base != nullptr)
+            munmap(m_base, m_capacity);
+        m_base = static_cast<char*>(p);
+        m_capacity = bytes;
+    }
+
+    [[noreturn]]
+    void fail(const char* what)
+    {
+        std::string msg = std::string(what) + " " + std::string(m_path) + ": " + std::strerror(errno);
+        if (m_fd >= 0 && m_base == nullptr)
+            close(m_fd);
+        throw std::runtime_error(msg);
+    }
+
+    std::pmr::string m_path;
+    int m_fd;
+    char* m_base;
+    std::size_t m_capacity;
+    std::uint64_t m_size;
+    std::uint64_t m_orphaned;
+};
+
+#endif // CHATCOLDFILE_INCLUDED
@@ -0,0 +1,121 @@
+#ifndef CHATEVENTFEED_INCLUDED
+#define CHATEVENTFEED_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+  // One change a ChatTracker made.  Users and chats are given by the ids
+  // the tracker interned them as; ChatTracker::userName and chatName turn
+  // them back into names.
+struct ChatEvent
+{
+    enum Op : std::uint8_t { Join, Contribute, Leave, Terminate, Expire };
+    static const std::uint32_t NO_USER = 0xFFFFFFFF;
+
+    std::uint32_t user;   // NO_USER for Terminate and Expire
+    std::uint32_t chat;
+    std::int64_t value;   // the membership's count afterwards, or the chat's total
+    Op op;
+};
+
+  // A preallocated ring of ChatEvents written by the tracker's thread and
+  // drained, in batches, by one consumer thread (which may be the same
+  // thread).  Nothing is allocated after construction.
+class ChatEventFeed
+{
+  public:
+    enum Overflow
+    {
+        DropNewest,  // a full ring discards new events
+        DropOldest,  // a full ring overwrites its oldest events
+        Block        // a full ring makes the tracker wait for the consumer
+    };
+
+    ChatEventFeed(std::size_t capacity, Overflow overflow, std::pmr::memory_resource* r)
+     : m_slots(r), m_overflow(overflow), m_head(0), m_tail(0), m_dropped(0)
+    {
+        std::size_t n = 1;
+        while (n < capacity)
+            n *= 2;
+        m_slots.resize(n);
+        m_mask = n - 1;
+    }
+
+      // Writer side.  Returns the event's sequence number, or -1 if it was
+      // dropped.
+    long long push(ChatEvent::Op op, std::uint32_t user, std::uint32_t chat, std::int64_t value)
+    {
+        std::uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        std::uint64_t head = m_head.load(std::memory_order_acquire);
+        while (tail - head == m_slots.size())
+        {
+            if (m_overflow == DropNewest)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+            }
+            if (m_overflow == DropOldest)
+            {
+                  // claim the oldest slot before overwriting it, so a
+                  // consumer copying it sees its own claim fail
+                if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel))
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            else
+            {
+                std::this_thread::yield();
+                head = m_head.load(std::memory_order_acquire);
+            }
+        }
+        ChatEvent& e = m_slots[tail & m_mask];
+        e.user = user;
+        e.chat = chat;
+        e.value = value;
+        e.op = op;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return static_cast<long long>(tail);
+    }
+
+      // Consumer side: moves up to max events into out, oldest first, and
+      // returns how many
+    std::size_t drain(ChatEvent* out, std::size_t max)
+    {
+        for (;;)
+        {
+            std::uint64_t head = m_head.load(std::memory_order_acquire);
+            std::uint64_t tail = m_tail.load(std::memory_order_acquire);
+            std::size_t n = static_cast<std::size_t>(tail - head);
+            if (n > max)
+                n = max;
+            for (std::size_t k = 0; k < n; k++)
+                out[k] = m_slots[(head + k) & m_mask];
+              // if the writer overwrote what we were copying, it moved head
+            if (m_head.compare_exchange_strong(head, head + n, std::memory_order_acq_rel))
+                return n;
+        }
+    }
+
+      // Every event with a sequence number below this has been drained or dropped
+    std::uint64_t consumed() const { return m_head.load(std::memory_order_acquire); }
+    std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    ChatEventFeed(const ChatEventFeed&) = delete;
+    ChatEventFeed& operator=(const ChatEventFeed&) = delete;
+
+  private:
+    std::pmr::vector<ChatEvent> m_slots;
+    std::size_t m_mask;
+    Overflow m_overflow;
+    alignas(64) std::atomic<std::uint64_t> m_head;
+    alignas(64) std::atomic<std::uint64_t> m_tail;
+    std::atomic<std::uint64_t> m_dropped;
+};
+
+#endif // CHATEVENTFEED_INCLUDED
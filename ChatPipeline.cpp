@@ -0,0 +1,199 @@
+//
+//  ChatPipeline.cpp
+//  project 4
+//
+
+#include <chrono>
+#include <functional>
+#include "ChatPipeline.h"
+
+using namespace std;
+
+namespace
+{
+    const size_t BATCH = 64;
+
+    bool isSpace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+    }
+
+    const char* skipSpace(const char* p, const char* end)
+    {
+        while (p != end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    const char* skipWord(const char* p, const char* end)
+    {
+        while (p != end && !isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // spin briefly, then yield, then sleep, so an idle stage does not burn a core
+    void backOff(int& spins)
+    {
+        spins++;
+        if (spins < 64)
+            return;
+        if (spins < 256)
+            this_thread::yield();
+        else
+            this_thread::sleep_for(chrono::microseconds(50));
+    }
+}
+
+//parses one line the way testChatTracker's Command::create does:
+//user names are one word, chat names are the rest of the line
+//returns 1 if cmd was filled, 0 for a blank line, -1 for a bad line;
+//a name the tracker would refuse is bad here, since nothing on the applying
+//thread could report the exception
+int ChatPipeline::parseLine(const char* p, const char* end, ChatCommand& cmd)
+{
+    p = skipSpace(p, end);
+    if (p == end)
+        return 0;
+    const char* opEnd = skipWord(p, end);
+    if (opEnd - p != 1)
+        return -1;
+    char op = *p;
+    cmd.numbered = false;
+
+    p = skipSpace(opEnd, end);
+    if (op == 't')
+    {
+        if (p == end)
+            return -1;
+        cmd.op = ChatCommand::Terminate;
+        cmd.chat = string_view(p, end - p);
+        if (cmd.chat.size() > ChatTracker::MAX_NAME)
+            return -1;
+        cmd.chatHash = hash<string_view>()(cmd.chat);
+        return 1;
+    }
+    if (op != 'j' && op != 'c' && op != 'l')
+        return -1;
+
+    const char* userEnd = skipWord(p, end);
+    if (userEnd == p)
+        return -1;
+    cmd.user = string_view(p, userEnd - p);
+    if (cmd.user.size() > ChatTracker::MAX_NAME)
+        return -1;
+    cmd.userHash = hash<string_view>()(cmd.user);
+    if (op == 'c')
+    {
+        cmd.op = ChatCommand::Contribute;
+        return 1;
+    }
+
+    p = skipSpace(userEnd, end);
+    if (p == end)
+    {
+        if (op == 'j')
+            return -1;
+        cmd.op = ChatCommand::LeaveCurrent;
+        return 1;
+    }
+    cmd.op = (op == 'j' ? ChatCommand::Join : ChatCommand::LeaveChat);
+    cmd.chat = string_view(p, end - p);
+    if (cmd.chat.size() > ChatTracker::MAX_NAME)
+        return -1;
+    cmd.chatHash = hash<string_view>()(cmd.chat);
+    return 1;
+}
+
+ChatPipeline::ChatPipeline(ChatTracker& ct, size_t ringCapacity, vector<int>* results)
+ : m_tracker(ct), m_results(results), m_ring(ringCapacity),
+   m_queued(0), m_malformed(0), m_applied(0), m_stop(false)
+{
+    m_thread = thread(&ChatPipeline::applyLoop, this);
+}
+
+ChatPipeline::~ChatPipeline()
+{
+    drain();
+    m_stop.store(true, memory_order_release);
+    m_thread.join();
+}
+
+size_t ChatPipeline::parse(const char* text, size_t len)
+{
+    ChatCommand batch[BATCH];
+    size_t n = 0;
+    size_t queued = 0;
+    const char* end = text + len;
+    const char* line = text;
+    while (line != end)
+    {
+        const char* lineEnd = line;
+        while (lineEnd != end && *lineEnd != '\n')
+            lineEnd++;
+
+        int r = parseLine(line, lineEnd, batch[n]);
+        if (r < 0)
+            m_malformed++;
+        else if (r > 0 && ++n == BATCH)
+        {
+            push(batch, n);
+            queued += n;
+            n = 0;
+        }
+        line = (lineEnd == end ? end : lineEnd + 1);
+    }
+    push(batch, n);
+    return queued + n;
+}
+
+//hands cmds to the tracker thread, waiting for room when the ring is full
+void ChatPipeline::push(const ChatCommand* cmds, size_t n)
+{
+    int spins = 0;
+    while (n > 0)
+    {
+        size_t pushed = m_ring.pushBatch(cmds, n);
+        if (pushed == 0)
+        {
+            backOff(spins);
+            continue;
+        }
+        spins = 0;
+        cmds += pushed;
+        n -= pushed;
+        m_queued += pushed;
+    }
+}
+
+void ChatPipeline::drain()
+{
+    int spins = 0;
+    while (m_applied.load(memory_order_acquire) != m_queued)
+        backOff(spins);
+}
+
+void ChatPipeline::applyLoop()
+{
+    ChatCommand batch[BATCH];
+    int spins = 0;
+    for (;;)
+    {
+        size_t n = m_ring.popBatch(batch, BATCH);
+        if (n == 0)
+        {
+            if (m_stop.load(memory_order_acquire))
+                return;
+            backOff(spins);
+            continue;
+        }
+        spins = 0;
+        for (size_t k = 0; k < n; k++)
+        {
+            int r = m_tracker.apply(batch[k]);
+            if (m_results != nullptr)
+                m_results->push_back(r);
+        }
+        m_applied.fetch_add(n, memory_order_release);
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef CHATPIPELINE_INCLUDED
+#define CHATPIPELINE_INCLUDED
+
+#include "ChatTracker.h"
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+  // A bounded lock-free queue between exactly one producer thread and one
+  // consumer thread.  Each side keeps a cached copy of the other side's
+  // index so that it only touches the other side's cache line when the
+  // ring looks full (or empty).
+template <typename T>
+class SpscRing
+{
+  public:
+    explicit SpscRing(std::size_t capacity)  // rounded up to a power of two
+     : m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+    {
+        std::size_t n = 1;
+        while (n < capacity)
+            n *= 2;
+        m_slots.resize(n);
+        m_mask = n - 1;
+    }
+
+      // Producer side: queues up to n items, returns how many were queued
+    std::size_t pushBatch(const T* items, std::size_t n)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead + n > m_slots.size())
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+        std::size_t room = m_slots.size() - (tail - m_cachedHead);
+        if (n > room)
+            n = room;
+        for (std::size_t k = 0; k < n; k++)
+            m_slots[(tail + k) & m_mask] = items[k];
+        m_tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+      // Consumer side: removes up to max items into out, returns how many
+    std::size_t popBatch(T* out, std::size_t max)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+                return 0;
+        }
+        std::size_t n = m_cachedTail - head;
+        if (n > max)
+            n = max;
+        for (std::size_t k = 0; k < n; k++)
+            out[k] = m_slots[(head + k) & m_mask];
+        m_head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+  private:
+    std::vector<T> m_slots;
+    std::size_t m_mask;
+      // written by the consumer
+    alignas(64) std::atomic<std::size_t> m_head;
+    std::size_t m_cachedTail;
+      // written by the producer
+    alignas(64) std::atomic<std::size_t> m_tail;
+    std::size_t m_cachedHead;
+};
+
+  // Pipelined ingestion: the thread that calls parse() turns command lines
+  // into ChatCommand records, and a second thread owned by the pipeline
+  // applies them to the tracker.  While the pipeline exists, only the
+  // pipeline's thread may use the tracker.
+class ChatPipeline
+{
+  public:
+      // If results is not null, the value of every applied command is
+      // appended to it in order; read it only after drain().
+    ChatPipeline(ChatTracker& ct, std::size_t ringCapacity = 4096,
+                 std::vector<int>* results = nullptr);
+    ~ChatPipeline();
+      // Parses text (lines in the same format as commands.txt) and queues
+      // the commands, waiting while the ring is full.  Malformed lines,
+      // which include those with a name longer than ChatTracker::MAX_NAME,
+      // are skipped.  text must stay valid until drain() returns.  Returns the
+      // number of commands queued.
+    std::size_t parse(const char* text, std::size_t len);
+      // Waits until every queued command has been applied
+    void drain();
+    std::size_t malformedLines() const { return m_malformed; }
+      // Parses the line [begin, end) (without its newline) the way the
+      // pipeline does: returns 1 if cmd was filled, 0 for a blank line, and
+      // -1 for a malformed one (or one with a name join would refuse).  cmd's names point into the line.
+    static int parseLine(const char* begin, const char* end, ChatCommand& cmd);
+    ChatPipeline(const ChatPipeline&) = delete;
+    ChatPipeline& operator=(const ChatPipeline&) = delete;
+
+  private:
+    void push(const ChatCommand* cmds, std::size_t n);
+    void applyLoop();
+
+    ChatTracker& m_tracker;
+    std::vector<int>* m_results;
+    SpscRing<ChatCommand> m_ring;
+    std::size_t m_queued;
+    std::size_t m_malformed;
+    std::atomic<std::size_t> m_applied;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
+
+#endif // CHATPIPELINE_INCLUDED
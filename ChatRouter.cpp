@@ -0,0 +1,136 @@
+//
+//  ChatRouter.cpp
+//  project 4
+//
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "ChatRouter.h"
+
+using namespace std;
+
+namespace
+{
+      // points on the ring per partition; more of them even out the shares
+    const uint32_t REPLICAS = 128;
+
+      // spreads hashes (std::hash of an integer may be the integer itself)
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+}
+
+ChatRouter::ChatRouter(size_t partitions, int maxBuckets)
+ : m_maxBuckets(maxBuckets), m_active(0)
+{
+    setPartitions(partitions);
+}
+
+void ChatRouter::buildRing(size_t partitions)
+{
+    m_ring.clear();
+    for (uint32_t p = 0; p < partitions; p++)
+    {
+        for (uint32_t r = 0; r < REPLICAS; r++)
+            m_ring.push_back(Point{ mix((uint64_t(p) << 32) | r), p });
+    }
+    sort(m_ring.begin(), m_ring.end());
+}
+
+  // the partition of the first point at or after the user's hash
+size_t ChatRouter::ownerOf(const string& user) const
+{
+    Point key{ mix(hash<string>()(user)), 0 };
+    auto it = lower_bound(m_ring.begin(), m_ring.end(), key);
+    if (it == m_ring.end())
+        it = m_ring.begin();
+    return it->partition;
+}
+
+void ChatRouter::setPartitions(size_t partitions)
+{
+    if (partitions == 0)
+        throw invalid_argument("a ChatRouter needs at least one partition");
+    while (m_trackers.size() < partitions)
+        m_trackers.emplace_back(new ChatTracker(m_maxBuckets));
+    size_t old = m_active;
+    buildRing(partitions);
+    m_active = partitions;
+
+      // only partitions that were hashed to have users with current chats
+    for (size_t p = 0; p < old; p++)
+    {
+        vector<string> users = m_trackers[p]->activeUsers();
+        for (size_t k = 0; k < users.size(); k++)
+        {
+            size_t q = ownerOf(users[k]);
+            if (q == p)
+                continue;
+              // rejoin oldest first, so the current chat ends up current
+            vector<pair<string, int>> taken = m_trackers[p]->extractUser(users[k]);
+            ChatTracker& to = *m_trackers[q];
+            for (size_t j = taken.size(); j > 0; j--)
+            {
+                to.join(users[k], taken[j - 1].first);
+                if (taken[j - 1].second != 0)
+                    to.contribute(users[k], taken[j - 1].second);
+            }
+        }
+    }
+}
+
+void ChatRouter::join(const string& user, const string& chat)
+{
+    owner(user).join(user, chat);
+}
+
+int ChatRouter::terminate(const string& chat)
+{
+    int total = 0;
+    for (size_t p = 0; p < m_trackers.size(); p++)
+        total += m_trackers[p]->terminate(chat);
+    return total;
+}
+
+int ChatRouter::contribute(const string& user)
+{
+    return owner(user).contribute(user);
+}
+
+int ChatRouter::leave(const string& user, const string& chat)
+{
+    return owner(user).leave(user, chat);
+}
+
+int ChatRouter::leave(const string& user)
+{
+    return owner(user).leave(user);
+}
+
+int ChatRouter::apply(const ChatCommand& cmd)
+{
+    if (cmd.numbered)
+        throw invalid_argument("a ChatRouter does not take numbered commands");
+    if (cmd.op == ChatCommand::Terminate)
+        return terminate(string(cmd.chat));
+    string user(cmd.user);
+    switch (cmd.op)
+    {
+      case ChatCommand::Join:
+        join(user, string(cmd.chat));
+        return 0;
+      case ChatCommand::Contribute:
+        return contribute(user);
+      case ChatCommand::ContributeMany:
+        return owner(user).contribute(user, cmd.count);
+      case ChatCommand::LeaveChat:
+        return leave(user, string(cmd.chat));
+      default:
+        return leave(user);
+    }
+}
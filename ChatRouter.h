@@ -0,0 +1,64 @@
+#ifndef CHATROUTER_INCLUDED
+#define CHATROUTER_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ChatTracker.h"
+
+  // A front end that spreads users over several independent ChatTrackers
+  // (partitions) and returns what a single ChatTracker would.  Users are
+  // placed by consistent hashing, so every operation on a user goes to the
+  // one partition that holds all of the user's memberships; terminate
+  // asks every partition and adds up their totals.  Numbered users and
+  // chats, expiry, events and recording are per partition and are not
+  // offered here.
+class ChatRouter
+{
+  public:
+    explicit ChatRouter(std::size_t partitions, int maxBuckets = 20000);
+    void join(const std::string& user, const std::string& chat);
+    int terminate(const std::string& chat);
+    int contribute(const std::string& user);
+    int leave(const std::string& user, const std::string& chat);
+    int leave(const std::string& user);
+      // Performs cmd, returning what the corresponding call above returns
+      // (0 for Join); throws std::invalid_argument for a numbered command
+    int apply(const ChatCommand& cmd);
+      // Changes the number of partitions, moving the users whose partition
+      // changes (about 1/partitions of them when growing by one) with
+      // their current memberships.  What users have left stays where it
+      // was, still counted by terminate, so a partition that shrinking
+      // drops from the hash is kept, and is hashed to again if the router
+      // grows back.  It and the constructor throw std::invalid_argument
+      // for 0 partitions.
+    void setPartitions(std::size_t partitions);
+    std::size_t partitions() const { return m_active; }
+      // Partition k, for callers that want to inspect it; changing it
+      // directly breaks the router's invariants
+    ChatTracker& partition(std::size_t k) { return *m_trackers[k]; }
+    ChatRouter(const ChatRouter&) = delete;
+    ChatRouter& operator=(const ChatRouter&) = delete;
+
+  private:
+    struct Point
+    {
+        std::uint64_t hash;
+        std::uint32_t partition;
+        bool operator<(const Point& other) const { return hash < other.hash; }
+    };
+
+    ChatTracker& owner(const std::string& user) { return *m_trackers[ownerOf(user)]; }
+    std::size_t ownerOf(const std::string& user) const;
+    void buildRing(std::size_t partitions);
+
+    int m_maxBuckets;
+    std::vector<std::unique_ptr<ChatTracker>> m_trackers;  // the first m_active are hashed to
+    std::size_t m_active;
+    std::vector<Point> m_ring;  // sorted
+};
+
+#endif // CHATROUTER_INCLUDED
@@ -0,0 +1,340 @@
+//
+//  ChatTrace.cpp
+//  project 4
+//
+
+#include <array>
+#include <climits>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include "ChatTrace.h"
+#include "ChatPipeline.h"
+
+using namespace std;
+
+namespace
+{
+    const char MAGIC[8] = { 'C', 'H', 'A', 'T', 'T', 'R', 'C', '\0' };
+
+    uint32_t crc32(const char* p, size_t n)
+    {
+        static const array<uint32_t, 256> table = [] {
+            array<uint32_t, 256> t;
+            for (uint32_t k = 0; k < 256; k++)
+            {
+                uint32_t c = k;
+                for (int b = 0; b < 8; b++)
+                    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                t[k] = c;
+            }
+            return t;
+        }();
+        uint32_t c = 0xFFFFFFFF;
+        for (size_t k = 0; k < n; k++)
+            c = table[(c ^ static_cast<unsigned char>(p[k])) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFF;
+    }
+
+    void putFixed(string& s, uint32_t v)
+    {
+        for (int k = 0; k < 4; k++)
+            s += static_cast<char>((v >> (8 * k)) & 0xFF);
+    }
+
+    void putVarint(string& s, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            s += static_cast<char>((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        s += static_cast<char>(v);
+    }
+
+    uint32_t getFixed(const char* p)
+    {
+        uint32_t v = 0;
+        for (int k = 0; k < 4; k++)
+            v |= uint32_t(static_cast<unsigned char>(p[k])) << (8 * k);
+        return v;
+    }
+
+    [[noreturn]]
+    void corrupt(const string& what)
+    {
+        throw runtime_error("bad chat trace: " + what);
+    }
+}
+
+//========================================================================
+// ChatTraceWriter
+
+ChatTraceWriter::ChatTraceWriter(ostream& out, size_t blockBytes)
+ : m_out(out), m_blockBytes(blockBytes)
+{
+    string header(MAGIC, sizeof(MAGIC));
+    putFixed(header, VERSION);
+    m_out.write(header.data(), header.size());
+}
+
+ChatTraceWriter::~ChatTraceWriter()
+{
+    flush();
+}
+
+//the id of name, defining it first if this is its first use
+uint64_t ChatTraceWriter::id(Ids& ids, Opcode define, string_view name)
+{
+    auto found = ids.byName.find(name);
+    if (found != ids.byName.end())
+        return found->second;
+
+    m_names.emplace_back(name);
+    uint64_t id = ids.byName.size() + ids.byNumber.size();
+    ids.byName.emplace(m_names.back(), id);
+
+    //names in a trace tend to differ only at the end
+    size_t shared = 0;
+    while (shared < name.size() && shared < ids.last.size() && name[shared] == ids.last[shared])
+        shared++;
+    putVarint(m_block, (uint64_t(shared) << 4) | define);
+    putVarint(m_block, name.size() - shared);
+    m_block.append(name.data() + shared, name.size() - shared);
+    ids.last.assign(name.data(), name.size());
+    return id;
+}
+
+//the same for a user or chat given by number
+uint64_t ChatTraceWriter::id(Ids& ids, Opcode define, uint64_t number)
+{
+    auto found = ids.byNumber.find(number);
+    if (found != ids.byNumber.end())
+        return found->second;
+
+    uint64_t id = ids.byName.size() + ids.byNumber.size();
+    ids.byNumber.emplace(number, id);
+    putVarint(m_block, (uint64_t(1) << 3) | define);
+    putVarint(m_block, number);
+    return id;
+}
+
+void ChatTraceWriter::record(const ChatCommand& cmd)
+{
+    uint64_t user = 0;
+    uint64_t chat = 0;
+    bool hasUser = (cmd.op != ChatCommand::Terminate);
+    bool hasChat = (cmd.op == ChatCommand::Join || cmd.op == ChatCommand::Terminate ||
+                    cmd.op == ChatCommand::LeaveChat);
+    if (hasUser)
+        user = (cmd.numbered ? id(m_users, DefineUser, cmd.userNumber) : id(m_users, DefineUser, cmd.user));
+    if (hasChat)
+        chat = (cmd.numbered ? id(m_chats, DefineChat, cmd.chatNumber) : id(m_chats, DefineChat, cmd.chat));
+
+    if (cmd.op == ChatCommand::ContributeMany)
+    {
+        putVarint(m_block, (user << 3) | ContributeMany);
+        int64_t n = cmd.count;
+        putVarint(m_block, n >= 0 ? uint64_t(n) * 2 : uint64_t(-n) * 2 - 1);
+    }
+    else
+        putVarint(m_block, ((hasUser ? user : chat) << 3) | cmd.op);
+    if (hasUser && hasChat)
+        putVarint(m_block, chat);
+    if (m_block.size() >= m_blockBytes)
+        flush();
+}
+
+void ChatTraceWriter::flush()
+{
+    if (!m_block.empty())
+    {
+        string framing;
+        putVarint(framing, m_block.size());
+        m_out.write(framing.data(), framing.size());
+        m_out.write(m_block.data(), m_block.size());
+        framing.clear();
+        putFixed(framing, crc32(m_block.data(), m_block.size()));
+        m_out.write(framing.data(), framing.size());
+        m_block.clear();
+    }
+    m_out.flush();
+}
+
+//========================================================================
+// ChatTraceReader
+
+ChatTraceReader::ChatTraceReader(istream& in)
+ : m_data(istreambuf_iterator<char>(in), istreambuf_iterator<char>())
+{
+    start();
+}
+
+ChatTraceReader::ChatTraceReader(string data)
+ : m_data(move(data))
+{
+    start();
+}
+
+void ChatTraceReader::start()
+{
+    if (m_data.size() < sizeof(MAGIC) + 4 || m_data.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0)
+        corrupt("not a trace");
+    //a version 1 trace is a version 2 trace without ContributeMany, and a
+    //version 2 trace is a version 3 trace whose defines have no flag bit
+    m_version = getFixed(m_data.data() + sizeof(MAGIC));
+    if (m_version < 1 || m_version > ChatTraceWriter::VERSION)
+        corrupt("unknown version");
+    m_pos = m_data.data() + sizeof(MAGIC) + 4;
+    m_block = m_blockEnd = m_pos;
+}
+
+uint64_t ChatTraceReader::getVarint(const char*& p, const char* end) const
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+            corrupt("truncated record");
+        unsigned char b = static_cast<unsigned char>(*p++);
+        v |= uint64_t(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return v;
+    }
+    corrupt("varint too long");
+}
+
+//checks the next block and makes it current; false at the end of the trace
+bool ChatTraceReader::nextBlock()
+{
+    const char* end = m_data.data() + m_data.size();
+    if (m_pos == end)
+        return false;
+    uint64_t n = getVarint(m_pos, end);
+    if (n > uint64_t(end - m_pos) || uint64_t(end - m_pos) - n < 4)
+        corrupt("truncated block");
+    if (crc32(m_pos, n) != getFixed(m_pos + n))
+        corrupt("checksum mismatch");
+    m_block = m_pos;
+    m_blockEnd = m_pos + n;
+    m_pos = m_blockEnd + 4;
+    return true;
+}
+
+void ChatTraceReader::define(vector<Name>& names, uint64_t shared, string& previous)
+{
+    if (m_version >= 3)
+    {
+        bool numbered = (shared & 1) != 0;
+        shared >>= 1;
+        if (numbered)
+        {
+            if (shared != 0)
+                corrupt("bad number");
+            names.push_back(Name{ string_view(), 0, true, getVarint(m_block, m_blockEnd) });
+            return;
+        }
+    }
+    uint64_t n = getVarint(m_block, m_blockEnd);
+    if (shared > previous.size() || n > uint64_t(m_blockEnd - m_block))
+        corrupt("bad name");
+    previous.resize(shared);
+    previous.append(m_block, n);
+    m_block += n;
+    m_names.push_back(previous);
+    string_view s(m_names.back());
+    names.push_back(Name{ s, hash<string_view>()(s), false, 0 });
+}
+
+const ChatTraceReader::Name& ChatTraceReader::lookup(const vector<Name>& names, uint64_t id) const
+{
+    if (id >= names.size())
+        corrupt("undefined name");
+    return names[id];
+}
+
+//sets cmd's user (or chat) to what name stands for
+void ChatTraceReader::setUser(ChatCommand& cmd, const Name& u)
+{
+    cmd.numbered = u.numbered;
+    cmd.user = u.s;
+    cmd.userHash = u.h;
+    cmd.userNumber = u.number;
+}
+
+void ChatTraceReader::setChat(ChatCommand& cmd, const Name& c)
+{
+    cmd.numbered = c.numbered;
+    cmd.chat = c.s;
+    cmd.chatHash = c.h;
+    cmd.chatNumber = c.number;
+}
+
+bool ChatTraceReader::next(ChatCommand& cmd)
+{
+    for (;;)
+    {
+        while (m_block == m_blockEnd)
+        {
+            if (!nextBlock())
+                return false;
+        }
+        uint64_t first = getVarint(m_block, m_blockEnd);
+        unsigned op = first & 7;
+        first >>= 3;
+        if (op == ChatTraceWriter::DefineUser)
+            define(m_users, first, m_lastUser);
+        else if (op == ChatTraceWriter::DefineChat)
+            define(m_chats, first, m_lastChat);
+        else if (op == ChatTraceWriter::ContributeMany)
+        {
+            setUser(cmd, lookup(m_users, first));
+            uint64_t z = getVarint(m_block, m_blockEnd);
+            int64_t n = (z & 1) ? -int64_t(z / 2) - 1 : int64_t(z / 2);
+            if (n < INT_MIN || n > INT_MAX)
+                corrupt("count too large");
+            cmd.op = ChatCommand::ContributeMany;
+            cmd.count = static_cast<int>(n);
+            return true;
+        }
+        else
+        {
+            cmd.op = ChatCommand::Op(op);
+            if (op == ChatTraceWriter::Terminate)
+            {
+                setChat(cmd, lookup(m_chats, first));
+                return true;
+            }
+            const Name& u = lookup(m_users, first);
+            setUser(cmd, u);
+            if (op == ChatTraceWriter::Join || op == ChatTraceWriter::LeaveChat)
+            {
+                setChat(cmd, lookup(m_chats, getVarint(m_block, m_blockEnd)));
+                if (cmd.numbered != u.numbered)
+                    corrupt("named and numbered keys in one record");
+            }
+            return true;
+        }
+    }
+}
+
+//========================================================================
+
+size_t convertChatTrace(istream& text, ostream& binary)
+{
+    ChatTraceWriter w(binary);
+    size_t skipped = 0;
+    string line;
+    while (getline(text, line))
+    {
+        ChatCommand cmd;
+        int r = ChatPipeline::parseLine(line.data(), line.data() + line.size(), cmd);
+        if (r < 0)
+            skipped++;
+        else if (r > 0)
+            w.record(cmd);
+    }
+    return skipped;
+}
@@ -0,0 +1,124 @@
+#ifndef CHATTRACE_INCLUDED
+#define CHATTRACE_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ChatTracker.h"
+
+  // A binary trace of tracker commands, a compact replacement for the text
+  // format of commands.txt.  A trace is
+  //   "CHATTRC" '\0', then the version as 4 bytes, least significant first
+  //   blocks, each a varint payload length, the payload, and the payload's
+  //     CRC-32 as 4 bytes, least significant first
+  // and a payload is a run of records.  Every record starts with a varint
+  // (LEB128) whose low 3 bits are its opcode and whose other bits are its
+  // first operand; any other operands follow as varints:
+  //   Join user chat,  Terminate chat,  Contribute user,
+  //   LeaveChat user chat,  LeaveCurrent user
+  //   ContributeMany user n   n zigzag encoded (0, -1, 1, -2, ... as
+  //                           0, 1, 2, 3, ...); new in version 2
+  //   DefineUser, DefineChat  shared * 2, length, then length characters:
+  //                           the name is the first shared characters of
+  //                           the previous name of its kind, then those
+  //                           (before version 3, shared itself)
+  //                           or 1, then a number: a user or chat given by
+  //                           number (see ChatCommand); new in version 3
+  // Users and chats are numbered separately from 0, in the order they are
+  // defined, and a name (or number) is defined once, in the record just
+  // before its first use.  A record's user and chat are either both named
+  // or both numbered.  No record spans two blocks.
+class ChatTraceWriter
+{
+  public:
+    static const std::uint32_t VERSION = 3;
+    enum Opcode : unsigned char
+    {
+        Join, Terminate, Contribute, LeaveChat, LeaveCurrent,  // as ChatCommand::Op
+        DefineUser, DefineChat, ContributeMany
+    };
+
+      // A block is ended once its payload reaches blockBytes
+    explicit ChatTraceWriter(std::ostream& out, std::size_t blockBytes = 64 * 1024);
+    ~ChatTraceWriter();  // flushes
+    void record(const ChatCommand& cmd);
+      // Ends the current block and flushes out
+    void flush();
+    ChatTraceWriter(const ChatTraceWriter&) = delete;
+    ChatTraceWriter& operator=(const ChatTraceWriter&) = delete;
+
+  private:
+      // the users (or chats) defined so far
+    struct Ids
+    {
+        std::unordered_map<std::string_view, std::uint64_t> byName;  // keyed by views of m_names
+        std::unordered_map<std::uint64_t, std::uint64_t> byNumber;
+        std::string last;  // the last name defined
+    };
+    std::uint64_t id(Ids& ids, Opcode define, std::string_view name);
+    std::uint64_t id(Ids& ids, Opcode define, std::uint64_t number);
+
+    std::ostream& m_out;
+    std::size_t m_blockBytes;
+    std::string m_block;
+    Ids m_users;
+    Ids m_chats;
+    std::deque<std::string> m_names;
+};
+
+  // Replays a trace.  The whole trace is loaded at once, and each name is
+  // hashed only when it is defined.
+class ChatTraceReader
+{
+  public:
+      // Both throw std::runtime_error if the data is not a trace of a
+      // version this reader knows (1 to 3)
+    explicit ChatTraceReader(std::istream& in);
+    explicit ChatTraceReader(std::string data);
+      // Sets cmd to the next command and returns true, or returns false at
+      // the end of the trace.  cmd's names stay valid as long as the
+      // reader.  Throws std::runtime_error if a block fails its checksum or
+      // is malformed.
+    bool next(ChatCommand& cmd);
+    ChatTraceReader(const ChatTraceReader&) = delete;
+    ChatTraceReader& operator=(const ChatTraceReader&) = delete;
+
+  private:
+    struct Name
+    {
+        std::string_view s;
+        std::size_t h;
+        bool numbered;
+        std::uint64_t number;
+    };
+
+    void start();
+    void define(std::vector<Name>& names, std::uint64_t shared, std::string& previous);
+    bool nextBlock();
+    std::uint64_t getVarint(const char*& p, const char* end) const;
+    const Name& lookup(const std::vector<Name>& names, std::uint64_t id) const;
+    static void setUser(ChatCommand& cmd, const Name& u);
+    static void setChat(ChatCommand& cmd, const Name& c);
+
+    std::string m_data;
+    std::uint32_t m_version;
+    const char* m_pos;        // the next block
+    const char* m_block;      // the next record in the current block
+    const char* m_blockEnd;
+    std::vector<Name> m_users;
+    std::vector<Name> m_chats;
+    std::deque<std::string> m_names;  // what m_users and m_chats refer to
+    std::string m_lastUser;
+    std::string m_lastChat;
+};
+
+  // Converts commands in the text format to a binary trace, skipping lines
+  // ChatPipeline::parseLine rejects, and returns how many were skipped
+std::size_t convertChatTrace(std::istream& text, std::ostream& binary);
+
+#endif // CHATTRACE_INCLUDED
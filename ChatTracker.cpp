@@ -7,621 +7,459 @@
 //
 
 #include <functional>
-#include <iostream>
+#include <memory>
+#include <new>
+#include <string_view>
 #include "ChatTracker.h"
+#include "BasicChatTracker.h"
+#include "ChatTrace.h"
 
 using namespace std;
 
-class ChatTrackerImpl
+// the whole implementation is in BasicChatTracker.h; ChatTracker hides it
+// behind a pointer so that its users need not include it
+class ChatTrackerImpl : public BasicChatTracker<ChatTrackerPolicy>
 {
 public:
-    ChatTrackerImpl(int maxBuckets);
-    void join(string user, string chat);
-    int terminate(string chat);
-    int contribute(string user);
-    int leave(string user, string chat);
-    int leave(string user);
-    ~ChatTrackerImpl();
-
-private:
-    struct Info
-    {
-        Info() : count(0){}
-        Info(string u, string c, Info* n=nullptr, Info* p=nullptr) : user(u), chat(c), count(0), next(n), prev(p) {}
-        string user;
-        string chat;
-        int count;
-        Info* next;
-        Info* prev;
-    };
-
-    struct HashTable
-    {
-        int max_buckets;
-        Info **t;
-        Info **top;
-
-        HashTable(){}
-
-        void generateHash(int buckets)
-        {
-            max_buckets=buckets;
-            t = new Info * [max_buckets];
-            top = new Info* [max_buckets];
-            for (int i = 0; i< max_buckets; i++) {
-                t[i] = nullptr;
-                top[i]=nullptr;
-            }
-        }
-    };
-
-    HashTable m_info;
-    int buckets;
-    HashTable m_usersWhoLeft;
-    HashTable m_chats;
-    int chat_buckets;
-    int deleteInfo(string user, string chat);
+    using BasicChatTracker::BasicChatTracker;
 };
 
+template class BasicChatTracker<ChatTrackerPolicy>;
 
-//this function deletes Info with user and chat from m_info and m_usersWhoLeft
-//it is used in terminate
-int ChatTrackerImpl::deleteInfo(string user, string chat)
-{
-    int total = 0;
-    int hash_v = hash<string>()(user)%buckets;
-    Info* p = m_info.t[hash_v];
-    while(p!=nullptr)
-    {
-        Info* temp = p->next;
-
-        if(p->chat == chat && p-> user == user)
-        {
-            total += p->count;
-            //if this is the only Info node
-            if(p->prev==nullptr && p->next == nullptr)
-            {
-                m_info.t[hash_v]=nullptr;
-                m_info.top[hash_v]=nullptr;
-            }
-            else if(p->prev == nullptr)
-            {
-                m_info.t[hash_v] = p->next;
-                p->next->prev = nullptr;
-            }
-            else if(p->next == nullptr)
-            {
-                p->prev->next = nullptr;
-                m_info.top[hash_v] = p->prev;
-            }
-            else
-            {
-                p->prev->next = p->next;
-                p->next->prev = p->prev;
-            }
-            delete p;
-        }
-        p = temp; //update p
+static_assert(ChatTracker::MAX_NAME == ChatTrackerImpl::Keys::MAX_NAME, "ChatTracker::MAX_NAME is out of date");
 
-    }
+static constexpr uint32_t NIL = ChatTrackerImpl::NIL;
+static constexpr uint32_t DEPARTED = ChatTrackerImpl::DEPARTED;
 
-    p = m_usersWhoLeft.t[hash_v];
-    while(p!=nullptr)
-    {
-        Info* temp = p->next;
-
-        if(p->chat == chat && p-> user == user)
-        {
-            total += p->count;
-            //if this is the only Info node
-            if(p->prev==nullptr && p->next == nullptr)
-            {
-                m_usersWhoLeft.t[hash_v]=nullptr;
-                m_usersWhoLeft.top[hash_v]=nullptr;
-            }
-            else if(p->prev == nullptr)
-            {
-                m_usersWhoLeft.t[hash_v] = p->next;
-                p->next->prev = nullptr;
-            }
-            else if(p->next == nullptr)
-            {
-                p->prev->next = nullptr;
-                m_usersWhoLeft.top[hash_v] = p->prev;
-            }
-            else
-            {
-                p->prev->next = p->next;
-                p->next->prev = p->prev;
-            }
-            delete p;
-        }
-        p = temp; //update p
 
-    }
+/* ================================================================= */
+/* ChatSnapshot implementation */
 
-    return total;
+ChatSnapshot::ChatSnapshot(shared_ptr<const ChatSnapshotState> s)
+ : m_state(s)
+{}
+
+ChatSnapshot::const_iterator ChatSnapshot::begin() const
+{
+    const_iterator it(m_state.get(), 0);
+    it.skipFree();
+    return it;
 }
 
-ChatTrackerImpl::ChatTrackerImpl(int maxBuckts)
+ChatSnapshot::const_iterator ChatSnapshot::end() const
 {
-    m_info.generateHash(maxBuckts);
-    m_usersWhoLeft.generateHash(maxBuckts);
-    buckets = maxBuckts;
-    chat_buckets = maxBuckts;
-    m_chats.generateHash(chat_buckets);
+    return const_iterator(m_state.get(), m_state->user.size);
 }
 
+int ChatSnapshot::chatTotal(const string& chat) const
+{
+    const ChatSnapshotState& s = *m_state;
+    if(s.chatBucket.size == 0)
+        return 0;
+    uint32_t c = s.chatBucket[hash<string_view>()(chat) % s.chatBucket.size];
+    while(c != NIL && s.chatName(c) != chat)
+        c = s.chatNext[c];
+    if(c == NIL)
+        return 0;
 
+    int total = 0;
+    for(uint32_t m = s.chatHead[c]; m != NIL; m = s.chatLink[m])
+        total += s.count[m];
+    return total;
+}
 
-/* ================================================================= */
-/* join(string user, string chat) implementation */
+ChatSnapshot::Membership ChatSnapshot::const_iterator::operator*() const
+{
+    Membership r;
+    r.user = m_state->userName(m_state->user[m_pos]);
+    r.chat = m_state->chatName(m_state->chat[m_pos]);
+    r.count = m_state->count[m_pos];
+    r.current = (m_state->userPrev[m_pos] != DEPARTED);
+    return r;
+}
 
-void ChatTrackerImpl::join(string user, string chat)
+ChatSnapshot::const_iterator& ChatSnapshot::const_iterator::operator++()
 {
-    //check if the user has joined this chat or not
-    //if so, change the chat to the user's current chat
-    //if not,
-        //let the user join the chat, and the chat is the user's current chat
+    m_pos++;
+    skipFree();
+    return *this;
+}
 
-    unsigned long hash_v = hash<string>()(user)%buckets;
-    Info *p = m_info.t[hash_v];
+void ChatSnapshot::const_iterator::skipFree()
+{
+    while(m_pos < m_state->user.size && (m_state->user[m_pos] == NIL || !m_state->live(m_pos)))
+        m_pos++;
+}
 
-    //if there is no info in the bucket, the user has not joined the chat yet
 
-    if(p==nullptr)
-    {
-        unsigned long chat_hash = hash<string>()(chat)%chat_buckets;
-        Info* temp = m_chats.top[chat_hash];
-        if(temp == nullptr)
-        {
-            m_chats.t[chat_hash] = new Info(user, chat);
-            m_chats.top[chat_hash] = m_chats.t[chat_hash];
-        }
-        else
-        {
-            temp->next = new Info(user, chat, nullptr, temp);
-            m_chats.top[chat_hash] = temp->next;
-        }
-        m_info.t[hash_v] = new Info(user, chat);
-        m_info.top[hash_v] = m_info.t[hash_v];
-        return;
-    }
 
-    while(p!=nullptr)
-    {
-        if(p->chat==chat && p->user==user)
-            break;
-        p=p->next;
-    }
 
 
-    //if the user has already joined the chat
-    if(p!=nullptr)
-    {
-        //if the chat is the last chat (including the case that it is the only chat)
-        if(p->next == nullptr)
-        {
-            //do nothing
-        }
-
-        //if the chat is the first chat but not the only chat
-        else if (p->prev == nullptr)
-        {
-            m_info.t[hash_v] = p->next;
-            p->next->prev = nullptr; // p->next is not nullptr, guaranteed by the previous if statement
-            Info* temp = m_info.top[hash_v];
-            temp->next = p;
-            p->next = nullptr;
-            p->prev = temp;
-            m_info.top[hash_v] = p;
-        }
-
-        //else
-        else
-        {
-            p->prev->next = p->next;
-            p->next->prev = p->prev;
-            Info* temp = p = m_info.top[hash_v];
-            temp->next = p;
-            p->prev = temp;
-            p->next = nullptr;
-            m_info.top[hash_v] = p;
-        }
-    }
 
-    // p == nullptr: the user has not joined the chat
-    else
-    {
-        //let the user join the chat, and the chat is the user's current chat
-
-        if(m_info.top[hash_v]==nullptr)
-        {
-            m_info.t[hash_v]=new Info(user, chat);
-            m_info.top[hash_v] = m_info.t[hash_v];
-        }
-        else
-        {
-            p = m_info.top[hash_v];
-            p->next = new Info(user, chat, nullptr, p);
-            m_info.top[hash_v] = p->next;
-        }
-
-        //updaate m_chats
-
-        unsigned long chat_hash = hash<string>()(chat)%chat_buckets;
-        Info* temp = m_chats.top[chat_hash];
-        if(temp == nullptr)
-        {
-            m_chats.t[chat_hash] = new Info(user, chat);
-            m_chats.top[chat_hash] = m_chats.t[chat_hash];
-        }
-        else
-        {
-            temp->next = new Info(user, chat, nullptr, temp);
-            m_chats.top[chat_hash] = temp->next;
-        }
+//*********** ChatTracker functions **************
 
-    }
+// These functions delegate to ChatTrackerImpl's functions.  Besides that,
+// they record each command for setRecorder once it has been carried out
+// (so one that throws is left out), turn ChatTrackerImpl's
+// membership slots into the ranges and Membership values the queries
+// return, and own the impl's memory.
 
+ChatTracker::Membership ChatTracker::MembershipRange::const_iterator::operator*() const
+{
+    ChatTrackerImpl::MemberView v = m_tracker->member(m_pos);
+    Membership r;
+    r.name = (m_byChat ? m_tracker->userName(v.user) : m_tracker->chatName(v.chat));
+    r.count = v.count;
+    r.current = v.current;
+    return r;
 }
 
-
-/* ================================================================= */
-/* leave(string user) implementation */
-
-int ChatTrackerImpl::leave(string user)
+ChatTracker::MembershipRange::const_iterator& ChatTracker::MembershipRange::const_iterator::operator++()
 {
-    unsigned long hash_v = hash<string>()(user)%buckets;
-    Info* p = m_info.top[hash_v]; //now p points to the last Info in the linked list
-
-    while(p != nullptr)
-    {
-        if(p->user == user)
-            break;
-        p = p->prev;
-    }
-    //at the end of this while loop, there can be two cases:
-    //1. p==nullptr: the user is not associated with any chat
-    //2. p!=nullptr: p points to the Info with the user, the user's current chat, and the user's contribution to that chat
+    m_pos = (m_byChat ? m_tracker->nextMember(m_pos) : m_tracker->nextChatOf(m_pos));
+    return *this;
+}
 
-    if(p==nullptr) //the user is not associated with any chat
+ChatTracker::ChatTracker(int maxBuckets, std::pmr::memory_resource* resource)
+ : m_resource(resource), m_recorder(nullptr)
+{
+    void* p = resource->allocate(sizeof(ChatTrackerImpl), alignof(ChatTrackerImpl));
+    try
     {
-        return -1;
+        m_impl = new (p) ChatTrackerImpl(maxBuckets, resource);
     }
-
-    else // p!=nullptr
+    catch (...)
     {
-        // remove first
-
-        // if this is the only info in the bucket
-        if(p->next == nullptr && p->prev == nullptr)
-        {
-            m_info.t[hash_v] = nullptr;
-            m_info.top[hash_v] = nullptr;
-        }
-
-        // else if this is the first info in the bucket
-        else if(p->prev == nullptr)
-        {
-            p->next->prev = nullptr;
-            m_info.t[hash_v] = p->next;
-        }
-
-        // else if this is the last info in the bucket
-        else if(p->next == nullptr)
-        {
-            p->prev->next = nullptr;
-            m_info.top[hash_v] = p->prev;
-        }
-
-        // else
-        else
-        {
-            p->next->prev = p->prev;
-            p->prev->next = p->next;
-        }
-
-        // then insert
-        if(m_usersWhoLeft.t[hash_v]==nullptr)
-        {
-            m_usersWhoLeft.top[hash_v] = p;
-            m_usersWhoLeft.t[hash_v] = p;
-            p->next = nullptr;
-            p->prev = nullptr;
-
-        }
-        else
-        {
-            Info* temp = m_usersWhoLeft.top[hash_v];
-            temp->next = p;
-            p->next = nullptr;
-            p->prev = temp;
-            m_usersWhoLeft.top[hash_v]=p;
-        }
-
-        
-        return p->count;
+        resource->deallocate(p, sizeof(ChatTrackerImpl), alignof(ChatTrackerImpl));
+        throw;
     }
 }
 
-/* ================================================================= */
-/* leave(string user, string chat) implementation */
+  // The tracker owns the region, so it cannot live in it
+ChatTracker::ChatTracker(const std::string& sharedName, std::size_t sharedBytes, int maxBuckets)
+ : m_resource(nullptr), m_recorder(nullptr)
+{
+    std::unique_ptr<SharedRegion> region(SharedRegion::create(sharedName, sharedBytes, maxBuckets));
+    m_impl = new ChatTrackerImpl(maxBuckets, std::move(region));
+}
 
-int ChatTrackerImpl::leave(string user, string chat)
+ChatSnapshot ChatTracker::snapshot()
 {
-    unsigned long hash_v = hash<string>()(user)%buckets;
-    Info* p = m_info.top[hash_v];
+    return ChatSnapshot(m_impl->snapshot());
+}
 
-    while(p != nullptr)
+ChatTracker::~ChatTracker()
+{
+    if (m_resource == nullptr)
+        delete m_impl;
+    else
     {
-        if(p->user == user && p->chat == chat)
-            break;
-        p = p->prev;
+        m_impl->~ChatTrackerImpl();
+        m_resource->deallocate(m_impl, sizeof(ChatTrackerImpl), alignof(ChatTrackerImpl));
     }
-    //at the end of this for loop, there can be two cases:
-    //1. p==nullptr: the user is not associated with the chat indicated
-    //2. p!=nullptr: p points to the Info with the user, the chat, and the user's contribution to that chat
+}
 
-    // if the user is not associated with the chat indicated
-    if(p==nullptr)
-        return -1;
+void ChatTracker::record(ChatCommand::Op op, std::string_view user, std::string_view chat, int count)
+{
+    ChatCommand cmd;
+    cmd.op = op;
+    cmd.numbered = false;
+    cmd.user = user;
+    cmd.chat = chat;
+    cmd.userHash = cmd.chatHash = 0;
+    cmd.count = count;
+    cmd.userNumber = cmd.chatNumber = 0;
+    m_recorder->record(cmd);
+}
 
-    //else: the user is associated with the chat
-    else
-    {
-        // remove first
-
-        // if this is the only info in the bucket
-        if(p->next == nullptr && p->prev == nullptr)
-        {
-            m_info.t[hash_v] = nullptr;
-            m_info.top[hash_v] = nullptr;
-        }
-
-        // else if this is the first info in the bucket
-        else if(p->prev == nullptr)
-        {
-            m_info.t[hash_v] = p->next;
-            p->next->prev = nullptr;
-        }
-
-        // else if this is the last info in the bucket
-        else if(p->next == nullptr)
-        {
-            p->prev->next = nullptr;
-            m_info.top[hash_v] = p->prev;
-        }
-
-        // else
-        else
-        {
-            p->next->prev = p->prev;
-            p->prev->next = p->next;
-        }
-
-        // then insert
-
-        if(m_usersWhoLeft.t[hash_v]==nullptr)
-        {
-            m_usersWhoLeft.top[hash_v] = p;
-            m_usersWhoLeft.t[hash_v] = p;
-            p->next = nullptr;
-            p->prev = nullptr;
-
-        }
-        else
-        {
-            Info* temp = m_usersWhoLeft.top[hash_v];
-            temp->next = p;
-            p->next = nullptr;
-            p->prev = temp;
-            m_usersWhoLeft.top[hash_v]=p;
-        }
-
-        return p->count;
-    }
+void ChatTracker::record(ChatCommand::Op op, std::uint64_t user, std::uint64_t chat, int count)
+{
+    ChatCommand cmd;
+    cmd.op = op;
+    cmd.numbered = true;
+    cmd.userHash = cmd.chatHash = 0;
+    cmd.count = count;
+    cmd.userNumber = user;
+    cmd.chatNumber = chat;
+    m_recorder->record(cmd);
 }
 
+void ChatTracker::join(string_view user, string_view chat)
+{
+    m_impl->join(user, chat);
+    if (m_recorder)
+        record(ChatCommand::Join, user, chat);
+}
 
+int ChatTracker::terminate(string_view chat)
+{
+    int result = m_impl->terminate(chat);
+    if (m_recorder)
+        record(ChatCommand::Terminate, "", chat);
+    return result;
+}
 
-/* ================================================================= */
-/* contribute(string user) implementation */
+int ChatTracker::contribute(string_view user)
+{
+    int result = m_impl->contribute(user);
+    if (m_recorder)
+        record(ChatCommand::Contribute, user, "");
+    return result;
+}
 
-int ChatTrackerImpl::contribute(string user)
+int ChatTracker::contribute(string_view user, int n)
 {
-    unsigned long hash_v = hash<string>()(user)%buckets;
-    Info *p = m_info.top[hash_v];
-    while(p!=nullptr)
-    {
-        if(p->user == user)
-            break;
-        p=p->prev;
-    }
-    // at the end of the while loop, there are two cases
-    // 1. p==nullptr: the user is not associated with any chat
-    // 2. p!=nullptr: p points to the Info with the user and the current chat
+    int result = m_impl->contribute(user, n);
+    if (m_recorder)
+        record(ChatCommand::ContributeMany, user, "", n);
+    return result;
+}
 
-    //if the user is not associated with any chat
-    if(p==nullptr)
-        return 0;
+int ChatTracker::leave(string_view user, string_view chat)
+{
+    int result = m_impl->leave(user, chat);
+    if (m_recorder)
+        record(ChatCommand::LeaveChat, user, chat);
+    return result;
+}
 
-    else
-    {
-        p->count++;
-        return p->count;
-    }
+int ChatTracker::leave(string_view user)
+{
+    int result = m_impl->leave(user);
+    if (m_recorder)
+        record(ChatCommand::LeaveCurrent, user, "");
+    return result;
 }
 
+void ChatTracker::join(uint64_t user, uint64_t chat)
+{
+    m_impl->join(ChatNumber{ user }, ChatNumber{ chat });
+    if (m_recorder)
+        record(ChatCommand::Join, user, chat);
+}
 
-/* ================================================================= */
-/* terminate(string chat) implementation */
+int ChatTracker::terminate(uint64_t chat)
+{
+    int result = m_impl->terminate(ChatNumber{ chat });
+    if (m_recorder)
+        record(ChatCommand::Terminate, uint64_t(0), chat);
+    return result;
+}
 
-int ChatTrackerImpl::terminate(string chat)
+int ChatTracker::contribute(uint64_t user)
 {
-    int total = 0;
+    int result = m_impl->contribute(ChatNumber{ user });
+    if (m_recorder)
+        record(ChatCommand::Contribute, user, uint64_t(0));
+    return result;
+}
 
-    unsigned long chat_hash = hash<string>()(chat)%chat_buckets;
-    Info* p = m_chats.t[chat_hash];
-    while(p != nullptr)
-    {
-        if(p->chat==chat)
-            break;
-        p = p->next;
-    }
-    // case 1: p == nullptr, the chat does not exist
-    // case 2: p != nullptr, the chat exists (but probably has no user associated with it)
+int ChatTracker::contribute(uint64_t user, int n)
+{
+    int result = m_impl->contribute(ChatNumber{ user }, n);
+    if (m_recorder)
+        record(ChatCommand::ContributeMany, user, uint64_t(0), n);
+    return result;
+}
 
-    // case 1: p == nullptr, the chat does not exist
-    if(p == nullptr)
-    {
-        return 0;
-    }
+int ChatTracker::leave(uint64_t user, uint64_t chat)
+{
+    int result = m_impl->leave(ChatNumber{ user }, ChatNumber{ chat });
+    if (m_recorder)
+        record(ChatCommand::LeaveChat, user, chat);
+    return result;
+}
 
-    // case 2: p != nullptr, the chat exists (but probably has no user associated with it)
-    for(Info* i = m_chats.t[chat_hash]; i!= nullptr; i=i->next)
-    {
-        if(i->chat!=chat){continue;}
+int ChatTracker::leave(uint64_t user)
+{
+    int result = m_impl->leave(ChatNumber{ user });
+    if (m_recorder)
+        record(ChatCommand::LeaveCurrent, user, uint64_t(0));
+    return result;
+}
 
-        total += deleteInfo(i->user, chat);
-    }
+void ChatTracker::setChatExpiry(long long ttl, std::function<void(const std::string&, int)> onExpire, int sweepPerOp)
+{
+    m_impl->setChatExpiry(ttl, onExpire, sweepPerOp);
+}
 
-    //delete relevant info in m_chats
+void ChatTracker::sweep(int maxChats)
+{
+    m_impl->sweep(maxChats);
+}
 
-    Info* j = m_chats.t[chat_hash];
-    while(j!=nullptr)
-    {
-        if(j->chat != chat)
-        {
-            j=j->next;
-            continue;
-        }
-
-        //delete j
-        Info* temp = j->next;
-
-        // if this is the only info in the bucket
-        if(j->next == nullptr && j->prev == nullptr)
-        {
-            m_chats.t[chat_hash] = nullptr;
-            m_chats.top[chat_hash] = nullptr;
-        }
-
-        // else if this is the first info in the bucket
-        else if(j->prev == nullptr)
-        {
-            m_chats.t[chat_hash] = j->next;
-            j->next->prev = nullptr;
-        }
-
-        // else if this is the last info in the bucket
-        else if(j->next == nullptr)
-        {
-            j->prev->next = nullptr;
-            m_chats.top[chat_hash] = j->prev;
-        }
-
-        // else
-        else
-        {
-            j->next->prev = j->prev;
-            j->prev->next = j->next;
-        }
-
-        delete j;
-        j=temp;
+void ChatTracker::setColdStorage(const std::string& path, long long idleOps, int spillPerOp)
+{
+    m_impl->setColdStorage(path, idleOps, spillPerOp);
+}
 
-    }
+std::vector<std::pair<std::string, int>> ChatTracker::coldMemberships(const std::string& chat) const
+{
+    return m_impl->coldMemberships(chat);
+}
 
+uint64_t ChatTracker::coldBytes() const
+{
+    return m_impl->coldBytes();
+}
 
-    return total;
+uint64_t ChatTracker::coldOrphanedBytes() const
+{
+    return m_impl->coldOrphanedBytes();
 }
 
+void ChatTracker::compactCold()
+{
+    m_impl->compactCold();
+}
 
-/* ================================================================= */
-/* ~ChatTrackerImpl() implementation */
+void ChatTracker::setContributeCache(std::size_t entries)
+{
+    m_impl->setContributeCache(entries);
+}
 
-ChatTrackerImpl::~ChatTrackerImpl()
+void ChatTracker::reset()
 {
-    Info* p1;
-    Info* p2;
-    for(int i=0; i<buckets; i++)
-    {
-        p1=m_usersWhoLeft.t[i];
-        p2=m_info.t[i];
-//        delete m_info.top[i];
-//        delete m_usersWhoLeft.top[i];
-        Info* temp1 = p1;
-        while(p1!=nullptr)
-        {
-            temp1=p1;
-            p1=p1->next;
-            delete temp1;
-        }
-        Info* temp2;
-        while(p2!=nullptr)
-        {
-            temp2=p2;
-            p2=p2->next;
-            delete temp2;
-        }
+    m_impl->reset();
+}
 
-    }
-    Info* p;
-    for(int i = 0; i<chat_buckets; i++)
-    {
-        p=m_chats.t[i];
-        Info* temp = p;
-        while(p!=nullptr){
-            temp = p;
-            p = p->next;
-            delete temp;
-        }
-    }
+void ChatTracker::enableEvents(std::size_t capacity, ChatEventFeed::Overflow overflow)
+{
+    m_impl->enableEvents(capacity, overflow);
 }
 
+void ChatTracker::disableEvents()
+{
+    m_impl->disableEvents();
+}
 
+std::size_t ChatTracker::drainEvents(ChatEvent* out, std::size_t max)
+{
+    return m_impl->drainEvents(out, max);
+}
 
+std::uint64_t ChatTracker::droppedEvents() const
+{
+    return m_impl->droppedEvents();
+}
 
+std::string_view ChatTracker::userName(std::uint32_t id) const
+{
+    return m_impl->userName(id);
+}
 
+std::string_view ChatTracker::chatName(std::uint32_t id) const
+{
+    return m_impl->chatName(id);
+}
 
-//*********** ChatTracker functions **************
+std::vector<int> ChatTracker::terminateMany(const std::vector<std::string>& chats)
+{
+    std::vector<int> totals = m_impl->terminateMany(chats);
+    if (m_recorder)
+    {
+        for (size_t k = 0; k < chats.size(); k++)
+            record(ChatCommand::Terminate, "", chats[k]);
+    }
+    return totals;
+}
 
-// These functions simply delegate to ChatTrackerImpl's functions.
-// You probably don't want to change any of this code.
+std::vector<std::pair<std::string, int>> ChatTracker::leaveAll(const std::string& user)
+{
+    std::vector<std::pair<std::string, int>> left = m_impl->leaveAll(user);
+    if (m_recorder)
+    {
+        for (size_t k = 0; k < left.size(); k++)
+            record(ChatCommand::LeaveChat, user, left[k].first);
+    }
+    return left;
+}
 
-ChatTracker::ChatTracker(int maxBuckets)
+std::vector<std::string> ChatTracker::activeUsers() const
 {
-    m_impl = new ChatTrackerImpl(maxBuckets);
+    return m_impl->activeUsers();
 }
 
-ChatTracker::~ChatTracker()
+std::vector<std::pair<std::string, int>> ChatTracker::extractUser(const std::string& user)
 {
-    delete m_impl;
+    return m_impl->extractUser(user);
 }
 
-void ChatTracker::join(string user, string chat)
+int ChatTracker::contribution(string_view user, string_view chat) const
 {
-    m_impl->join(user, chat);
+    return m_impl->contribution(user, chat);
 }
 
-int ChatTracker::terminate(string chat)
+bool ChatTracker::currentChat(string_view user, Membership& current) const
 {
-    return m_impl->terminate(chat);
+    MembershipRange r = chatsOf(user);
+    if (r.empty())
+        return false;
+    current = *r.begin();
+    return true;
 }
 
-int ChatTracker::contribute(string user)
+ChatTracker::MembershipRange ChatTracker::chatsOf(string_view user) const
 {
-    return m_impl->contribute(user);
+    return MembershipRange(m_impl, m_impl->chatsOf(user), false);
 }
 
-int ChatTracker::leave(string user, string chat)
+ChatTracker::MembershipRange ChatTracker::members(string_view chat) const
 {
-    return m_impl->leave(user, chat);
+    return MembershipRange(m_impl, m_impl->members(chat), true);
 }
 
-int ChatTracker::leave(string user)
+int ChatTracker::apply(const ChatCommand& cmd)
 {
-    return m_impl->leave(user);
+    if (cmd.numbered)
+        return applyNumbered(cmd);
+    ChatTrackerImpl::KeyArg user(cmd.user, cmd.userHash);
+    ChatTrackerImpl::KeyArg chat(cmd.chat, cmd.chatHash);
+    int result = 0;
+    switch (cmd.op)
+    {
+      case ChatCommand::Join:
+        m_impl->join(user, chat);
+        break;
+      case ChatCommand::Terminate:
+        result = m_impl->terminate(chat);
+        break;
+      case ChatCommand::Contribute:
+        result = m_impl->contribute(user);
+        break;
+      case ChatCommand::LeaveChat:
+        result = m_impl->leave(user, chat);
+        break;
+      case ChatCommand::LeaveCurrent:
+        result = m_impl->leave(user);
+        break;
+      case ChatCommand::ContributeMany:
+        result = m_impl->contribute(user, cmd.count);
+        break;
+    }
+    if (m_recorder)
+        m_recorder->record(cmd);
+    return result;
 }
 
+//a numbered command goes through the integer overloads, which record it
+int ChatTracker::applyNumbered(const ChatCommand& cmd)
+{
+    switch (cmd.op)
+    {
+      case ChatCommand::Join:
+        join(cmd.userNumber, cmd.chatNumber);
+        return 0;
+      case ChatCommand::Terminate:
+        return terminate(cmd.chatNumber);
+      case ChatCommand::Contribute:
+        return contribute(cmd.userNumber);
+      case ChatCommand::LeaveChat:
+        return leave(cmd.userNumber, cmd.chatNumber);
+      case ChatCommand::LeaveCurrent:
+        return leave(cmd.userNumber);
+      case ChatCommand::ContributeMany:
+        return contribute(cmd.userNumber, cmd.count);
+    }
+    return 0;
+}
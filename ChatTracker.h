@@ -2,26 +2,296 @@
 #ifndef CHATTRACKER_INCLUDED
 #define CHATTRACKER_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ChatEventFeed.h"
 
 class ChatTrackerImpl;
+class ChatTraceWriter;
+struct ChatSnapshotState;
+
+  // One j/c/l/t command that has already been parsed, with its names
+  // hashed by std::hash<std::string_view>.  The names are not copied, so
+  // the characters they refer to must outlive the call to apply.  A
+  // numbered command gives its user and chat by number instead, as the
+  // integer overloads of ChatTracker's operations take them.
+struct ChatCommand
+{
+    enum Op : unsigned char { Join, Terminate, Contribute, LeaveChat, LeaveCurrent, ContributeMany };
+    Op op;
+    bool numbered;          // if so, the names and hashes are unused
+    std::string_view user;  // unused by Terminate
+    std::string_view chat;  // unused by Contribute, LeaveCurrent and ContributeMany
+    std::size_t userHash;
+    std::size_t chatHash;
+    int count;              // ContributeMany only: the n of contribute(user, n)
+    std::uint64_t userNumber;  // numbered commands only
+    std::uint64_t chatNumber;
+};
+
+  // A frozen view of a ChatTracker as it was when snapshot() was called.
+  // Taking one costs the same however big the tracker is, and other
+  // threads may read it while the tracker keeps changing: afterwards the
+  // tracker copies each page of its tables the first time it changes it.
+  // Copies of a snapshot share it, and the pages only it still uses are
+  // given back once the last copy is gone.  A snapshot must not outlive
+  // its tracker.
+class ChatSnapshot
+{
+  public:
+    struct Membership
+    {
+        std::string_view user;
+        std::string_view chat;
+        int count;
+        bool current;  // false once the user has left the chat
+    };
+
+    class const_iterator
+    {
+      public:
+        Membership operator*() const;
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const { return m_pos == other.m_pos; }
+        bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+      private:
+        friend class ChatSnapshot;
+        const_iterator(const ChatSnapshotState* s, std::size_t pos) : m_state(s), m_pos(pos) {}
+        void skipFree();
+        const ChatSnapshotState* m_state;
+        std::size_t m_pos;
+    };
+
+      // Every membership, current or departed, in no particular order
+    const_iterator begin() const;
+    const_iterator end() const;
+      // What terminate(chat) would have returned
+    int chatTotal(const std::string& chat) const;
+
+  private:
+    friend class ChatTracker;
+    explicit ChatSnapshot(std::shared_ptr<const ChatSnapshotState> s);
+    std::shared_ptr<const ChatSnapshotState> m_state;
+};
 
 class ChatTracker
 {
   public:
-    ChatTracker(int maxBuckets = 20000);
+      // A membership as the queries below report it: the chat (for
+      // chatsOf) or the user (for members), and the user's contribution
+    struct Membership
+    {
+        std::string_view name;
+        int count;
+        bool current;  // false once the user has left the chat
+    };
+
+      // The memberships a query found.  Nothing is copied: the range walks
+      // the tracker's own lists as it is iterated, so it (and every name
+      // it gives) must not be used once the tracker changes.
+    class MembershipRange
+    {
+      public:
+        class const_iterator
+        {
+          public:
+            Membership operator*() const;
+            const_iterator& operator++();
+            bool operator==(const const_iterator& other) const { return m_pos == other.m_pos; }
+            bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+          private:
+            friend class MembershipRange;
+            const_iterator(const ChatTrackerImpl* t, std::uint32_t pos, bool byChat)
+             : m_tracker(t), m_pos(pos), m_byChat(byChat) {}
+            const ChatTrackerImpl* m_tracker;
+            std::uint32_t m_pos;
+            bool m_byChat;
+        };
+
+        const_iterator begin() const { return const_iterator(m_tracker, m_first, m_byChat); }
+        const_iterator end() const { return const_iterator(m_tracker, 0xFFFFFFFF, m_byChat); }
+        bool empty() const { return m_first == 0xFFFFFFFF; }
+
+      private:
+        friend class ChatTracker;
+        MembershipRange(const ChatTrackerImpl* t, std::uint32_t first, bool byChat)
+         : m_tracker(t), m_first(first), m_byChat(byChat) {}
+        const ChatTrackerImpl* m_tracker;
+        std::uint32_t m_first;
+        bool m_byChat;
+    };
+
+      // Every allocation the tracker makes for itself (the tracker, its
+      // names and tables, the event feed, the contribute cache and cold
+      // storage bookkeeping) comes from resource, which must outlive the
+      // tracker.  The exceptions are what is handed back to the caller
+      // (snapshots, which may be dropped on another thread, and the
+      // vectors and strings returned), and the expiry callback.
+    ChatTracker(int maxBuckets = 20000,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+      // Keeps all of the tracker's tables in a shared region of sharedBytes
+      // bytes (see SharedRegion.h) that ChatTrackerReader objects in other
+      // processes can map.  Throws std::runtime_error if the region cannot
+      // be created, and std::bad_alloc if it is too small for the tracker
+      // (the region is then unmapped) or later fills up.
+    ChatTracker(const std::string& sharedName, std::size_t sharedBytes, int maxBuckets = 20000);
     ~ChatTracker();
-    void join(std::string user, std::string chat);
-    int terminate(std::string chat);
-    int contribute(std::string user);
-    int leave(std::string user, std::string chat);
-    int leave(std::string user);
+      // Names may be up to MAX_NAME characters long; join throws
+      // std::length_error for a longer one, leaving the user's memberships
+      // as they were
+    static constexpr std::size_t MAX_NAME = 65536;
+    void join(std::string_view user, std::string_view chat);
+      // Takes the same time however many members chat has: their
+      // memberships are freed a few at a time by the operations after it,
+      // and a join to chat afterwards starts it over
+    int terminate(std::string_view chat);
+    int contribute(std::string_view user);
+      // Adds n to the user's contribution to the current chat and returns
+      // the new count.  Any n is accepted, zero or negative too, and it is
+      // recorded as it is, as one ContributeMany command.
+    int contribute(std::string_view user, int n);
+    int leave(std::string_view user, std::string_view chat);
+    int leave(std::string_view user);
+      // Terminates every chat in chats, returning what terminate would have
+      // returned for each, in the same order
+    std::vector<int> terminateMany(const std::vector<std::string>& chats);
+      // Leaves every chat user is associated with, returning each chat and
+      // the user's contribution to it, starting with the current chat
+    std::vector<std::pair<std::string, int>> leaveAll(const std::string& user);
+      // The users (other than numbered ones) who have a current chat
+    std::vector<std::string> activeUsers() const;
+      // Takes every chat user is associated with out of the tracker, as if
+      // the user had never joined it, and returns each chat and the user's
+      // contribution to it, starting with the current chat.  Unlike
+      // leaveAll, the contributions no longer count toward terminate.
+      // This is for moving users between trackers (see ChatRouter.h); it
+      // is not recorded and makes no events.
+    std::vector<std::pair<std::string, int>> extractUser(const std::string& user);
+      // The same operations for callers that identify users and chats by
+      // number: no name is formatted, hashed or stored.  Numbers and names
+      // are separate keys, so the user numbered 7 is not the user named
+      // "7", and a numbered user or chat has an empty name in snapshots,
+      // readers, events and expiry callbacks.  They are recorded as
+      // numbered commands.
+    void join(std::uint64_t user, std::uint64_t chat);
+    int terminate(std::uint64_t chat);
+    int contribute(std::uint64_t user);
+    int contribute(std::uint64_t user, int n);
+    int leave(std::uint64_t user, std::uint64_t chat);
+    int leave(std::uint64_t user);
+      // Queries that change nothing; each costs a name lookup plus the
+      // size of what it returns.
+      // The user's contribution to a chat the user is associated with, or
+      // -1 if the user is not associated with that chat
+    int contribution(std::string_view user, std::string_view chat) const;
+      // If user is associated with any chat, sets current to the user's
+      // current chat and returns true
+    bool currentChat(std::string_view user, Membership& current) const;
+      // Every chat user is associated with, starting with the current chat
+    MembershipRange chatsOf(std::string_view user) const;
+      // Every user who has joined chat since it was last terminated, newest
+      // first, including those who have left (but not those whose
+      // memberships setColdStorage has moved to its file; with cold storage
+      // on, those who have left come after those who haven't)
+    MembershipRange members(std::string_view chat) const;
+      // Performs cmd, returning what the corresponding call above returns
+      // (0 for Join)
+    int apply(const ChatCommand& cmd);
+      // Expires chats that have had no join, contribute or leave during the
+      // last ttl operations, as if terminate had been called on them, and
+      // calls onExpire(chat, total) with the total terminate would have
+      // returned.  Each operation checks only sweepPerOp chats, so the
+      // work is spread out.  onExpire must not call back into the tracker.
+      // A ttl of 0 turns expiry off.
+    void setChatExpiry(long long ttl,
+                       std::function<void(const std::string&, int)> onExpire,
+                       int sweepPerOp = 4);
+      // Tiered storage: moves departed memberships out of memory into an
+      // append-only, memory-mapped file at path (created, or emptied if it
+      // exists).  Each operation looks at spillPerOp chats, round robin,
+      // and moves a chat's departed memberships to the file as one run
+      // once there are 16 of them or the chat has had no join, contribute
+      // or leave for idleOps operations.  In memory a chat keeps only
+      // their total, so terminate, snapshots and readers still count them
+      // without reading the file, but snapshots no longer list them.
+      // Calling this again only changes idleOps and spillPerOp.  Throws
+      // std::runtime_error if the file cannot be made.
+    void setColdStorage(const std::string& path, long long idleOps = 1000, int spillPerOp = 4);
+      // The memberships of chat that have been moved to the file, as each
+      // user and the user's contribution, newest first
+    std::vector<std::pair<std::string, int>> coldMemberships(const std::string& chat) const;
+      // How much of the file is in use, and how much of that belongs to
+      // chats terminated since
+    std::uint64_t coldBytes() const;
+    std::uint64_t coldOrphanedBytes() const;
+      // Copies the runs still needed to a new file that replaces the old
+      // one, dropping the orphaned ones.  This takes time in proportion to
+      // the file, so no other operation does it; call it when
+      // coldOrphanedBytes() says enough of the file is wasted.
+    void compactCold();
+      // Checks up to maxChats more chats for expiry (for callers that
+      // prefer to sweep on a timer)
+    void sweep(int maxChats);
+      // Makes contribute combine repeated calls in a cache of entries users
+      // (rounded up to a power of two), or stops if entries is 0.  A cached
+      // contribute returns the exact count, but its count reaches the
+      // tables only when some other operation, snapshot or sweep is called.
+      // Until then readers of a shared region do not see it and it does not
+      // count as activity for expiry, and a run of them by one user makes a
+      // single Contribute event.
+    void setContributeCache(std::size_t entries);
+      // Empties the tracker, keeping its settings and the memory it has
+      // already allocated, so filling it again is cheaper than with a new
+      // tracker.  Events not yet drained may refer to ids that are reused
+      // afterwards, and a reset is not recorded.
+    void reset();
+      // A point-in-time view for other threads to read; must be called on
+      // the thread that changes the tracker
+    ChatSnapshot snapshot();
+      // Starts recording a ChatEvent for every join, contribute, leave,
+      // terminate and expiry in a ring of capacity events (rounded up to a
+      // power of two), replacing any earlier feed.  With Block, the events
+      // must be drained on another thread.  While the feed is off, the
+      // tracker does no more than test a pointer.
+    void enableEvents(std::size_t capacity,
+                      ChatEventFeed::Overflow overflow = ChatEventFeed::DropNewest);
+    void disableEvents();
+      // Moves up to max of the oldest events into out and returns how many.
+      // At most one thread at a time may drain.
+    std::size_t drainEvents(ChatEvent* out, std::size_t max);
+      // Events lost to overflow so far
+    std::uint64_t droppedEvents() const;
+      // The names behind the ids in events (empty for an unknown id).  A
+      // terminated chat's name stays available until the operation after
+      // its Terminate or Expire event is drained, and so does the name of a
+      // user nothing in the tracker refers to any more, until the operation
+      // after the user's last event is drained.  After that the id may be
+      // given to another chat or user.  Like every other call
+      // but drainEvents, these must be made on the tracker's thread.
+    std::string_view userName(std::uint32_t id) const;
+    std::string_view chatName(std::uint32_t id) const;
+      // Records every command from now on to recorder (see ChatTrace.h), or
+      // stops recording if it is null.  terminateMany and leaveAll are
+      // recorded as the terminate and leave calls they stand for.
+    void setRecorder(ChatTraceWriter* recorder) { m_recorder = recorder; }
       // We prevent a ChatTracker object from being copied or assigned
     ChatTracker(const ChatTracker&) = delete;
     ChatTracker& operator=(const ChatTracker&) = delete;
 
   private:
     ChatTrackerImpl* m_impl;
+    std::pmr::memory_resource* m_resource;  // where m_impl is, or null if it was made by new
+    ChatTraceWriter* m_recorder;
+    void record(ChatCommand::Op op, std::string_view user, std::string_view chat, int count = 0);
+    void record(ChatCommand::Op op, std::uint64_t user, std::uint64_t chat, int count = 0);
+    int applyNumbered(const ChatCommand& cmd);
 };
 
 #endif // SYMBOLTABLE_INCLUDED
@@ -0,0 +1,202 @@
+//
+//  ChatTrackerReader.cpp
+//  project 4
+//
+
+#include <functional>
+#include <thread>
+#include "ChatTrackerReader.h"
+#include "SharedRegion.h"
+
+using namespace std;
+
+namespace
+{
+    const uint32_t NIL = 0xFFFFFFFF;
+}
+
+// The tables as the directory describes them during one attempt at a
+// lookup.  While the writer is busy they may be half updated, so every
+// index is checked, and any bad one just clears ok; the attempt is then
+// thrown away because the sequence number will have changed.
+struct ChatTrackerReader::Attempt
+{
+    Attempt(const SharedRegion& r) : base(r.base()), h(r.header()), ok(true) {}
+
+    //where element i of array a is, or nullptr (and ok cleared) if that
+    //is not inside the region; pages hold 2^shift elements of elemSize bytes
+    const char* locate(SharedArray a, uint64_t i, size_t elemSize)
+    {
+        const SharedHeader::Entry& e = h.dir[a];
+        if (i >= e.count || e.shift > 32)
+        {
+            ok = false;
+            return nullptr;
+        }
+        uint64_t page = i >> e.shift;
+        uint64_t slot = e.offset + page * 2 * sizeof(uint64_t);
+        if (slot + sizeof(uint64_t) > h.size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        uint64_t data = reinterpret_cast<const uint64_t*>(base + slot)[0] - h.writerBase;
+        uint64_t within = i & ((uint64_t(1) << e.shift) - 1);
+        if (data + ((uint64_t(1) << e.shift) * elemSize) > h.size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        return base + data + within * elemSize;
+    }
+
+    template <typename T>
+    T at(SharedArray a, uint64_t i)
+    {
+        const char* p = locate(a, i, sizeof(T));
+        return p == nullptr ? T() : *reinterpret_cast<const T*>(p);
+    }
+
+    //a name never spans two pages, so its characters are contiguous
+    string_view name(SharedArray first, uint32_t id)
+    {
+        uint32_t off = at<uint32_t>(SharedArray(first + 2), id);
+        uint32_t len = at<uint32_t>(SharedArray(first + 3), id);
+        if (!ok || len == 0)
+            return string_view();
+        const char* p = locate(SharedArray(first + 4), off, 1);
+        const char* last = locate(SharedArray(first + 4), uint64_t(off) + len - 1, 1);
+        if (!ok || last != p + len - 1)
+        {
+            ok = false;
+            return string_view();
+        }
+        return string_view(p, len);
+    }
+
+    //first is UserBucket or ChatBucket
+    uint32_t find(SharedArray first, const string& s)
+    {
+        uint64_t buckets = h.dir[first].count;
+        if (buckets == 0)
+            return NIL;
+        uint32_t id = at<uint32_t>(first, hash<string_view>()(s) % buckets);
+        for (uint64_t steps = 0; ok && id != NIL; steps++)
+        {
+            if (steps > h.dir[first + 1].count)
+                ok = false;
+            else if (name(first, id) == s)
+                return id;
+            else
+                id = at<uint32_t>(SharedArray(first + 1), id);
+        }
+        return NIL;
+    }
+
+    //a membership stays in its user's list for a while after its chat is
+    //terminated; the chat's generation has moved on by then
+    bool live(uint32_t m)
+    {
+        uint32_t c = at<uint32_t>(MemberChat, m);
+        return at<uint32_t>(MemberGeneration, m) == at<uint32_t>(ChatGeneration, c);
+    }
+
+    //a list is never longer than the membership columns
+    bool tooLong(uint64_t steps)
+    {
+        if (steps > h.dir[MemberChat].count)
+            ok = false;
+        return !ok;
+    }
+
+    const char* base;
+    const SharedHeader& h;
+    bool ok;
+};
+
+ChatTrackerReader::ChatTrackerReader(const string& sharedName)
+ : m_region(SharedRegion::openReadOnly(sharedName))
+{}
+
+ChatTrackerReader::~ChatTrackerReader()
+{
+    delete m_region;
+}
+
+template <typename F>
+void ChatTrackerReader::readConsistent(F f) const
+{
+    for (;;)
+    {
+        uint64_t seq = m_region->readBegin();
+        Attempt s(*m_region);
+        f(s);
+        if (!m_region->changedSince(seq))
+            return;
+        this_thread::yield();
+    }
+}
+
+bool ChatTrackerReader::currentChat(const string& user, string& chat, int& count) const
+{
+    bool found = false;
+    readConsistent([&](Attempt& s) {
+        found = false;
+        uint32_t u = s.find(UserBucket, user);
+        if (u == NIL)
+            return;
+        uint32_t m = s.at<uint32_t>(UserHead, u);
+        for (uint64_t steps = 0; m != NIL && !s.live(m) && !s.tooLong(steps); steps++)
+            m = s.at<uint32_t>(MemberUserNext, m);
+        if (!s.ok || m == NIL)
+            return;
+        string_view name = s.name(ChatBucket, s.at<uint32_t>(MemberChat, m));
+        count = s.at<int>(MemberCount, m);
+        if (!s.ok)
+            return;
+        chat.assign(name.data(), name.size());
+        found = true;
+    });
+    return found;
+}
+
+int ChatTrackerReader::contribution(const string& user, const string& chat) const
+{
+    int result = -1;
+    readConsistent([&](Attempt& s) {
+        result = -1;
+        uint32_t u = s.find(UserBucket, user);
+        uint32_t c = s.find(ChatBucket, chat);
+        if (u == NIL || c == NIL)
+            return;
+        uint32_t m = s.at<uint32_t>(UserHead, u);
+        for (uint64_t steps = 0; m != NIL && !s.tooLong(steps); steps++)
+        {
+            if (s.at<uint32_t>(MemberChat, m) == c  &&  s.live(m))
+            {
+                result = s.at<int>(MemberCount, m);
+                return;
+            }
+            m = s.at<uint32_t>(MemberUserNext, m);
+        }
+    });
+    return result;
+}
+
+int ChatTrackerReader::chatTotal(const string& chat) const
+{
+    int total = 0;
+    readConsistent([&](Attempt& s) {
+        total = 0;
+        uint32_t c = s.find(ChatBucket, chat);
+        if (c == NIL)
+            return;
+        uint32_t m = s.at<uint32_t>(ChatHead, c);
+        for (uint64_t steps = 0; m != NIL && !s.tooLong(steps); steps++)
+        {
+            total += s.at<int>(MemberCount, m);
+            m = s.at<uint32_t>(MemberChatNext, m);
+        }
+    });
+    return total;
+}
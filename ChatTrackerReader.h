@@ -0,0 +1,40 @@
+#ifndef CHATTRACKERREADER_INCLUDED
+#define CHATTRACKERREADER_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class SharedRegion;
+
+  // Read-only lookups on a ChatTracker that lives in a shared region,
+  // usually from another process.  Nothing is copied out of the region
+  // except the answers.  Every lookup sees the tracker as it was between
+  // two operations: if the writer changes it in the middle of a lookup,
+  // the lookup is simply retried.  Both processes must be built with the
+  // same standard library, since names are found with std::hash.
+class ChatTrackerReader
+{
+  public:
+      // Throws std::runtime_error if sharedName is not a tracker region
+    explicit ChatTrackerReader(const std::string& sharedName);
+    ~ChatTrackerReader();
+      // If user is associated with any chat, sets chat to the user's current
+      // chat and count to the user's contribution to it, and returns true
+    bool currentChat(const std::string& user, std::string& chat, int& count) const;
+      // The user's contribution to a chat the user is associated with, or
+      // -1 if the user is not associated with that chat
+    int contribution(const std::string& user, const std::string& chat) const;
+      // What terminate(chat) would return right now
+    int chatTotal(const std::string& chat) const;
+    ChatTrackerReader(const ChatTrackerReader&) = delete;
+    ChatTrackerReader& operator=(const ChatTrackerReader&) = delete;
+
+  private:
+    struct Attempt;
+    template <typename F> void readConsistent(F f) const;
+
+    SharedRegion* m_region;
+};
+
+#endif // CHATTRACKERREADER_INCLUDED
@@ -0,0 +1,346 @@
+#ifndef PAGEDCOLUMN_INCLUDED
+#define PAGEDCOLUMN_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
+
+  // Bookkeeping shared by all the columns of one tracker.  Taking a
+  // snapshot freezes everything that exists and starts a new epoch; a page
+  // (or page table) made in an earlier epoch may be seen by a snapshot, so
+  // a column copies it before changing it and retires the old copy, which
+  // is freed once no live snapshot can see it.  Only the writer's thread
+  // calls these functions; snapshots may be dropped on any thread.
+class Epochs
+{
+  public:
+    explicit Epochs(std::pmr::memory_resource* r)
+     : m_resource(r), m_current(0), m_retired(r), m_live(r), m_released(0), m_seenReleased(0)
+    {}
+
+    ~Epochs()
+    {
+        for (std::size_t k = 0; k < m_retired.size(); k++)
+            free(m_retired[k]);
+    }
+
+    std::pmr::memory_resource* resource() const { return m_resource; }
+    std::uint64_t current() const { return m_current; }
+
+      // Registers a snapshot held through snap and returns the epoch it
+      // sees.  Whoever drops the last reference to snap must call
+      // released() afterwards.
+    std::uint64_t freeze(std::weak_ptr<void> snap)
+    {
+        m_live.push_back(Live{ m_current, snap });
+        return m_current++;
+    }
+
+    void released() { m_released.fetch_add(1, std::memory_order_release); }
+
+      // p was made during epoch born and is no longer used by the writer
+    void retire(void* p, std::size_t bytes, std::uint64_t born)
+    {
+        Block b = { p, bytes, born, m_current };
+        if (visible(b))
+            m_retired.push_back(b);
+        else
+            free(b);
+    }
+
+      // Frees what no live snapshot can see any more, if a snapshot has
+      // been dropped since the last call; cheap to call on every operation
+    void reclaim()
+    {
+        unsigned r = m_released.load(std::memory_order_acquire);
+        if (r == m_seenReleased)
+            return;
+        m_seenReleased = r;
+
+        std::size_t n = 0;
+        for (std::size_t k = 0; k < m_live.size(); k++)
+        {
+            if (!m_live[k].snap.expired())
+                m_live[n++] = m_live[k];
+        }
+        m_live.resize(n);
+
+        n = 0;
+        for (std::size_t k = 0; k < m_retired.size(); k++)
+        {
+            if (visible(m_retired[k]))
+                m_retired[n++] = m_retired[k];
+            else
+                free(m_retired[k]);
+        }
+        m_retired.resize(n);
+    }
+
+  private:
+    struct Block
+    {
+        void* p;
+        std::size_t bytes;
+        std::uint64_t born;
+        std::uint64_t retired;
+    };
+    struct Live
+    {
+        std::uint64_t epoch;
+        std::weak_ptr<void> snap;
+    };
+
+      // a snapshot of epoch e saw b if b existed then and had not been replaced
+    bool visible(const Block& b) const
+    {
+        for (std::size_t k = 0; k < m_live.size(); k++)
+        {
+            if (b.born <= m_live[k].epoch && m_live[k].epoch < b.retired)
+                return true;
+        }
+        return false;
+    }
+
+    void free(const Block& b)
+    {
+        m_resource->deallocate(b.p, b.bytes, alignof(std::max_align_t));
+    }
+
+    std::pmr::memory_resource* m_resource;
+    std::uint64_t m_current;
+    std::pmr::vector<Block> m_retired;
+    std::pmr::vector<Live> m_live;
+    std::atomic<unsigned> m_released;
+    unsigned m_seenReleased;
+};
+
+  // One page's worth of a column, and the epoch in which the page was made
+template <typename T>
+struct PageSlot
+{
+    T* data;
+    std::uint64_t epoch;
+};
+
+  // A frozen column, as a snapshot sees it
+template <typename T, int SHIFT>
+struct ColumnView
+{
+    const PageSlot<T>* slots;
+    std::size_t size;
+
+    const T& operator[](std::size_t i) const
+    {
+        return slots[i >> SHIFT].data[i & ((std::size_t(1) << SHIFT) - 1)];
+    }
+};
+
+  // A growable array of trivially copyable T kept in pages of 2^SHIFT
+  // elements, so that a snapshot can share it and the writer only copies
+  // the pages it changes afterwards.  Reading is operator[]; anything that
+  // writes must go through edit(), which does the copying.
+template <typename T, int SHIFT = 12>
+class PagedColumn
+{
+  public:
+    static const std::size_t PAGE = std::size_t(1) << SHIFT;
+
+    explicit PagedColumn(Epochs* e)
+     : m_epochs(e), m_slots(nullptr), m_pages(0), m_tableCap(0), m_tableEpoch(e->current()), m_size(0),
+       m_fill(nullptr), m_fillEpoch(0)
+    {}
+
+      // The tracker must outlive its snapshots, so everything can go now
+    ~PagedColumn()
+    {
+        for (std::size_t k = 0; k < m_pages; k++)
+        {
+            if (m_slots[k].epoch != FILLED)
+                deallocate(m_slots[k].data, PAGE * sizeof(T));
+        }
+        deallocate(m_slots, m_tableCap * sizeof(PageSlot<T>));
+        deallocate(m_fill, PAGE * sizeof(T));
+    }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const T& operator[](std::size_t i) const
+    {
+        return m_slots[i >> SHIFT].data[i & (PAGE - 1)];
+    }
+
+    T& edit(std::size_t i)
+    {
+        std::uint64_t cur = m_epochs->current();
+        if (m_tableEpoch != cur)
+            ownTable();
+        PageSlot<T>& s = m_slots[i >> SHIFT];
+        if (s.epoch != cur)
+            ownPage(s);
+        return s.data[i & (PAGE - 1)];
+    }
+
+    void push_back(const T& v)
+    {
+        if (m_size == m_pages * PAGE)
+            addPage();
+        edit(m_size++) = v;
+    }
+
+      // Appends n elements that are guaranteed to sit in one page, starting
+      // a new page if the current one is too full; returns the index of
+      // the first one.  Throws std::length_error if n is more than a page.
+    std::size_t appendContiguous(const T* p, std::size_t n)
+    {
+        if (n > PAGE)
+            throw std::length_error("PagedColumn: element run longer than a page");
+        if (n == 0)
+            return m_size;
+        if ((m_size & (PAGE - 1)) + n > PAGE)
+            m_size = (m_size + PAGE - 1) & ~(PAGE - 1);  // the next page, which reuse() may have kept
+        if (m_size == m_pages * PAGE)
+            addPage();
+        std::size_t start = m_size;
+        std::memcpy(&edit(start), p, n * sizeof(T));
+        m_size += n;
+        return start;
+    }
+
+      // n copies of v.  Every page starts out as one shared page of v and
+      // gets a page of its own the first time it is changed, so this costs
+      // the same however big n is.
+    void assign(std::size_t n, const T& v)
+    {
+        clear();
+        if (n == 0)
+            return;
+        if (m_fill == nullptr || std::memcmp(&m_fill[0], &v, sizeof(T)) != 0)
+        {
+            release(m_fill, PAGE * sizeof(T), m_fillEpoch);
+            m_fill = static_cast<T*>(allocate(PAGE * sizeof(T)));
+            for (std::size_t k = 0; k < PAGE; k++)
+                m_fill[k] = v;
+            m_fillEpoch = m_epochs->current();
+        }
+        std::size_t pages = (n + PAGE - 1) >> SHIFT;
+        growTable(pages);
+        for (std::size_t k = 0; k < pages; k++)
+            m_slots[k] = PageSlot<T>{ m_fill, FILLED };
+        m_pages = pages;
+        m_size = n;
+    }
+
+      // Gives back every page; pages a snapshot might see are retired
+    void clear()
+    {
+        for (std::size_t k = 0; k < m_pages; k++)
+        {
+            if (m_slots[k].epoch != FILLED)
+                release(m_slots[k].data, PAGE * sizeof(T), m_slots[k].epoch);
+        }
+        release(m_slots, m_tableCap * sizeof(PageSlot<T>), m_tableEpoch);
+        m_slots = nullptr;
+        m_pages = m_tableCap = m_size = 0;
+        m_tableEpoch = m_epochs->current();
+    }
+
+      // Empties the column but keeps its pages for what is pushed next;
+      // the pages a snapshot might see are still copied before they change
+    void reuse() { m_size = 0; }
+
+    void swap(PagedColumn& other)
+    {
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_pages, other.m_pages);
+        std::swap(m_tableCap, other.m_tableCap);
+        std::swap(m_tableEpoch, other.m_tableEpoch);
+        std::swap(m_size, other.m_size);
+        std::swap(m_fill, other.m_fill);
+        std::swap(m_fillEpoch, other.m_fillEpoch);
+    }
+
+      // Where the pages are now; a snapshot must have frozen the column
+      // (see Epochs::freeze) for this to stay valid
+    ColumnView<T, SHIFT> view() const { return ColumnView<T, SHIFT>{ m_slots, m_size }; }
+    const PageSlot<T>* slots() const { return m_slots; }
+
+    PagedColumn(const PagedColumn&) = delete;
+    PagedColumn& operator=(const PagedColumn&) = delete;
+
+  private:
+    void* allocate(std::size_t bytes)
+    {
+        return m_epochs->resource()->allocate(bytes, alignof(std::max_align_t));
+    }
+
+    void deallocate(void* p, std::size_t bytes)
+    {
+        if (p != nullptr)
+            m_epochs->resource()->deallocate(p, bytes, alignof(std::max_align_t));
+    }
+
+    void release(void* p, std::size_t bytes, std::uint64_t born)
+    {
+        if (p != nullptr)
+            m_epochs->retire(p, bytes, born);
+    }
+
+      // the page table belongs to an earlier epoch: copy it
+    void ownTable()
+    {
+        growTable(m_tableCap);
+    }
+
+    void growTable(std::size_t cap)
+    {
+        if (cap < 4)
+            cap = 4;
+        PageSlot<T>* t = static_cast<PageSlot<T>*>(allocate(cap * sizeof(PageSlot<T>)));
+        if (m_pages != 0)
+            std::memcpy(t, m_slots, m_pages * sizeof(PageSlot<T>));
+        release(m_slots, m_tableCap * sizeof(PageSlot<T>), m_tableEpoch);
+        m_slots = t;
+        m_tableCap = cap;
+        m_tableEpoch = m_epochs->current();
+    }
+
+    void ownPage(PageSlot<T>& s)
+    {
+        T* p = static_cast<T*>(allocate(PAGE * sizeof(T)));
+        std::memcpy(p, s.data, PAGE * sizeof(T));
+        if (s.epoch != FILLED)
+            release(s.data, PAGE * sizeof(T), s.epoch);
+        s.data = p;
+        s.epoch = m_epochs->current();
+    }
+
+      // the epoch of a page that is still the shared page of assign()
+    static const std::uint64_t FILLED = ~std::uint64_t(0);
+
+    void addPage()
+    {
+        if (m_tableEpoch != m_epochs->current() || m_pages == m_tableCap)
+            growTable(m_pages == m_tableCap ? 2 * m_tableCap : m_tableCap);
+        T* p = static_cast<T*>(allocate(PAGE * sizeof(T)));
+        m_slots[m_pages].data = p;
+        m_slots[m_pages].epoch = m_epochs->current();
+        m_pages++;
+    }
+
+    Epochs* m_epochs;
+    PageSlot<T>* m_slots;
+    std::size_t m_pages;
+    std::size_t m_tableCap;
+    std::uint64_t m_tableEpoch;
+    std::size_t m_size;
+    T* m_fill;  // the page assign() filled, shared by every page not yet changed
+    std::uint64_t m_fillEpoch;
+};
+
+#endif // PAGEDCOLUMN_INCLUDED
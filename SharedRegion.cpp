@@ -0,0 +1,204 @@
+//
+//  SharedRegion.cpp
+//  project 4
+//
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SharedRegion.h"
+
+using namespace std;
+
+namespace
+{
+    const size_t MIN_BLOCK = 64;
+
+    bool isShmName(const string& name)
+    {
+        return name.size() > 1 && name[0] == '/' && name.find('/', 1) == string::npos;
+    }
+
+    int openName(const string& name, int flags)
+    {
+        if (isShmName(name))
+            return shm_open(name.c_str(), flags, 0644);
+        return open(name.c_str(), flags, 0644);
+    }
+
+    [[noreturn]]
+    void fail(const string& what, const string& name)
+    {
+        throw runtime_error(what + " " + name + ": " + strerror(errno));
+    }
+
+    //the size class of a block big enough for bytes
+    int sizeClass(size_t bytes)
+    {
+        int k = 0;
+        while ((MIN_BLOCK << k) < bytes)
+            k++;
+        return k;
+    }
+
+    size_t headerBytes()
+    {
+        return (sizeof(SharedHeader) + MIN_BLOCK - 1) / MIN_BLOCK * MIN_BLOCK;
+    }
+}
+
+SharedRegion::SharedRegion(char* base, size_t size)
+ : m_base(base), m_size(size), m_header(reinterpret_cast<SharedHeader*>(base))
+{}
+
+SharedRegion* SharedRegion::create(const string& name, size_t bytes, int maxBuckets)
+{
+    if (bytes < headerBytes())
+        bytes = headerBytes();
+    int fd = openName(name, O_RDWR | O_CREAT | O_TRUNC);
+    if (fd < 0)
+        fail("cannot create", name);
+      // the file is sparse, so untouched space costs nothing
+    if (ftruncate(fd, bytes) != 0)
+    {
+        close(fd);
+        fail("cannot size", name);
+    }
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        fail("cannot map", name);
+
+    SharedRegion* r = new SharedRegion(static_cast<char*>(p), bytes);
+    SharedHeader* h = new (p) SharedHeader;
+    h->version = SharedHeader::VERSION;
+    h->maxBuckets = maxBuckets;
+    h->size = bytes;
+    h->used = headerBytes();
+    h->writerBase = reinterpret_cast<uint64_t>(p);
+    for (int k = 0; k < SharedHeader::NUM_SIZE_CLASSES; k++)
+        h->freeList[k] = 0;
+    h->seq.store(0, memory_order_relaxed);
+    for (int a = 0; a < NumSharedArrays; a++)
+        h->dir[a].offset = h->dir[a].count = h->dir[a].shift = 0;
+      // readers check the magic number last
+    atomic_thread_fence(memory_order_release);
+    h->magic = SharedHeader::MAGIC;
+    return r;
+}
+
+SharedRegion* SharedRegion::openReadOnly(const string& name)
+{
+    int fd = openName(name, O_RDONLY);
+    if (fd < 0)
+        fail("cannot open", name);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < headerBytes())
+    {
+        close(fd);
+        errno = EINVAL;
+        fail("not a chat tracker region:", name);
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        fail("cannot map", name);
+
+    SharedRegion* r = new SharedRegion(static_cast<char*>(p), st.st_size);
+    if (r->m_header->magic != SharedHeader::MAGIC || r->m_header->version != SharedHeader::VERSION)
+    {
+        delete r;
+        errno = EINVAL;
+        fail("not a chat tracker region:", name);
+    }
+    return r;
+}
+
+void SharedRegion::remove(const string& name)
+{
+    if (isShmName(name))
+        shm_unlink(name.c_str());
+    else
+        unlink(name.c_str());
+}
+
+SharedRegion::~SharedRegion()
+{
+    munmap(m_base, m_size);
+}
+
+void SharedRegion::beginWrite()
+{
+    m_header->seq.store(m_header->seq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void SharedRegion::publish(SharedArray a, const void* pageTable, size_t count, int shift)
+{
+    m_header->dir[a].offset = (pageTable == nullptr ? 0 : static_cast<const char*>(pageTable) - m_base);
+    m_header->dir[a].count = count;
+    m_header->dir[a].shift = shift;
+}
+
+void SharedRegion::endWrite()
+{
+    m_header->seq.store(m_header->seq.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+uint64_t SharedRegion::readBegin() const
+{
+    for (;;)
+    {
+        uint64_t s = m_header->seq.load(memory_order_acquire);
+        if ((s & 1) == 0)
+            return s;
+    }
+}
+
+bool SharedRegion::changedSince(uint64_t seq) const
+{
+    atomic_thread_fence(memory_order_acquire);
+    return m_header->seq.load(memory_order_relaxed) != seq;
+}
+
+//blocks come in power-of-two sizes, and a freed block goes on the free
+//list for its size, with the offset of the next free block in its first word
+void* SharedRegion::do_allocate(size_t bytes, size_t alignment)
+{
+    if (alignment > MIN_BLOCK)
+        throw bad_alloc();
+    int k = sizeClass(bytes);
+    if (k >= SharedHeader::NUM_SIZE_CLASSES)
+        throw bad_alloc();
+
+    uint64_t off = m_header->freeList[k];
+    if (off != 0)
+    {
+        m_header->freeList[k] = *reinterpret_cast<uint64_t*>(m_base + off);
+        return m_base + off;
+    }
+
+    size_t blockSize = MIN_BLOCK << k;
+    if (m_header->used + blockSize > m_size)
+        throw bad_alloc();
+    off = m_header->used;
+    m_header->used += blockSize;
+    return m_base + off;
+}
+
+void SharedRegion::do_deallocate(void* p, size_t bytes, size_t)
+{
+    int k = sizeClass(bytes);
+    *static_cast<uint64_t*>(p) = m_header->freeList[k];
+    m_header->freeList[k] = static_cast<char*>(p) - m_base;
+}
+
+bool SharedRegion::do_is_equal(const pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,92 @@
+#ifndef SHAREDREGION_INCLUDED
+#define SHAREDREGION_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+  // The arrays a ChatTracker keeps in a shared region.  The region's
+  // directory records where each one currently starts and how many
+  // elements it has, as an offset from the start of the region, since
+  // every process maps the region at a different address.
+enum SharedArray
+{
+    UserBucket, UserNext, UserNameOffset, UserNameLength, UserChars,
+    ChatBucket, ChatNext, ChatNameOffset, ChatNameLength, ChatChars,
+    UserHead, ChatHead,
+    MemberUser, MemberChat, MemberCount, MemberUserNext, MemberUserPrev, MemberChatNext,
+    ChatLastActive, MemberGeneration, ChatGeneration,
+    NumSharedArrays
+};
+
+struct SharedHeader
+{
+    static const std::uint64_t MAGIC = 0x4b52544348415443ULL;  // "CTAHCTRK"
+    static const std::uint32_t VERSION = 3;
+    static const int NUM_SIZE_CLASSES = 40;  // block sizes 64 << k
+
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t maxBuckets;
+    std::uint64_t size;  // bytes in the region, this header included
+    std::uint64_t used;  // bytes handed out so far, this header included
+      // where the writer has the region mapped, to turn its pointers into offsets
+    std::uint64_t writerBase;
+    std::uint64_t freeList[NUM_SIZE_CLASSES];  // offset of the first free block, or 0
+      // odd while the writer is in the middle of an operation
+    std::atomic<std::uint64_t> seq;
+      // Every array is kept in pages of 2^shift elements (see PagedColumn.h);
+      // offset locates the table of {page pointer, epoch} pairs
+    struct Entry
+    {
+        std::uint64_t offset;
+        std::uint64_t count;
+        std::uint64_t shift;
+    };
+    Entry dir[NumSharedArrays];
+};
+
+  // A POSIX shared memory object or a file, mapped into this process.  The
+  // writer uses it as the memory resource for all of a ChatTracker's
+  // arrays; readers map it read-only and use the directory in its header
+  // to find them.  Names like "/chats" (a leading slash and no other) are
+  // shared memory objects; anything else is a file path.
+class SharedRegion : public std::pmr::memory_resource
+{
+  public:
+      // Both throw std::runtime_error if the region cannot be mapped
+    static SharedRegion* create(const std::string& name, std::size_t bytes, int maxBuckets);
+    static SharedRegion* openReadOnly(const std::string& name);
+      // Removes the name; processes that have it mapped keep their mapping
+    static void remove(const std::string& name);
+    ~SharedRegion();
+
+    const SharedHeader& header() const { return *m_header; }
+    const char* base() const { return m_base; }
+
+      // Writer side: a seqlock around every operation
+    void beginWrite();
+    void publish(SharedArray a, const void* pageTable, std::size_t count, int shift);
+    void endWrite();
+
+      // Reader side: returns an even sequence number to pass to changedSince
+    std::uint64_t readBegin() const;
+    bool changedSince(std::uint64_t seq) const;
+
+    SharedRegion(const SharedRegion&) = delete;
+    SharedRegion& operator=(const SharedRegion&) = delete;
+
+  private:
+    SharedRegion(char* base, std::size_t size);
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    char* m_base;
+    std::size_t m_size;
+    SharedHeader* m_header;
+};
+
+#endif // SHAREDREGION_INCLUDED
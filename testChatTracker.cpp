@@ -8,12 +8,30 @@
 //   l userName           which requests a call to leave(userName)
 
 #include "ChatTracker.h"
+#include "BasicChatTracker.h"
+#include "ChatPipeline.h"
+#include "ChatTrace.h"
+#include "ChatRouter.h"
+#include "ChatTrackerReader.h"
+#include "SharedRegion.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <cstdlib>
+#include <map>
+#include <iomanip>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <memory_resource>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 const char* commandFileName = "commands.txt";
@@ -43,7 +61,7 @@ struct Command
     static Command* create(string line, int lineno);
     Command(string line, int lineno) : m_line(line), m_lineno(lineno) {}
     virtual ~Command() {}
-    virtual void execute(ChatTracker& ct) const = 0;
+    virtual int execute(ChatTracker& ct) const = 0;
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const = 0;
     string m_line;
     int m_lineno;
@@ -52,9 +70,29 @@ struct Command
 void extractCommands(istream& dataf, vector<Command*>& commands);
 string testCorrectness(const vector<Command*>& commands);
 void testPerformance(const vector<Command*>& commands);
+void testProfile(const vector<Command*>& commands);
+void testPipelined(const string& text, const vector<Command*>& commands);
+string testExpiry();
+string testShared();
+string testSnapshot(const vector<Command*>& commands);
+string testBulk(const vector<Command*>& commands);
+string testEvents(const vector<Command*>& commands);
+string testPolicy(const vector<Command*>& commands);
+string testNumbers(const vector<Command*>& commands);
+string testCombining(const vector<Command*>& commands);
+string testRouter(const vector<Command*>& commands);
+string testCold(const vector<Command*>& commands);
+string testReset(const vector<Command*>& commands);
+string testQueries(const vector<Command*>& commands);
+string testResource(const vector<Command*>& commands);
+string testDeferred();
+string testTrace(const string& text, const vector<Command*>& commands);
 
-int main()
+  // With -p (or --profile), the performance test also reports hardware
+  // counters per command type
+int main(int argc, char* argv[])
 {
+    bool profile = (argc > 1  &&  (string(argv[1]) == "-p"  ||  string(argv[1]) == "--profile"));
     vector<Command*> commands;
 
       // Basic correctness test
@@ -102,6 +140,12 @@ int main()
         delete commands[k];
     commands.clear();
 
+    cout << "Expiry test: " << flush;
+    cout << testExpiry() << endl;
+
+    cout << "Shared memory test: " << flush;
+    cout << testShared() << endl;
+
       // Thorough correctness and performance tests
 
     ifstream thoroughf(commandFileName);
@@ -117,9 +161,61 @@ int main()
     cout << "Thorough correctness test: " << flush;
     cout << testCorrectness(commands) << endl;
 
+    cout << "Snapshot test: " << flush;
+    cout << testSnapshot(commands) << endl;
+
+    cout << "Bulk operations test: " << flush;
+    cout << testBulk(commands) << endl;
+
+    cout << "Event feed test: " << flush;
+    cout << testEvents(commands) << endl;
+
+    cout << "Policy test: " << flush;
+    cout << testPolicy(commands) << endl;
+
+    cout << "Numbered keys test: " << flush;
+    cout << testNumbers(commands) << endl;
+
+    cout << "Write-combining test: " << flush;
+    cout << testCombining(commands) << endl;
+
+    cout << "Partitioned router test: " << flush;
+    cout << testRouter(commands) << endl;
+
+    cout << "Tiered storage test: " << flush;
+    cout << testCold(commands) << endl;
+
+    cout << "Reset test: " << flush;
+    cout << testReset(commands) << endl;
+
+    cout << "Query test: " << flush;
+    cout << testQueries(commands) << endl;
+
+    cout << "Memory resource test: " << flush;
+    cout << testResource(commands) << endl;
+
+    cout << "Deferred terminate test: " << flush;
+    cout << testDeferred() << endl;
+
     cout << "Performance test on " << commands.size() << " commands: " << flush;
     testPerformance(commands);
 
+    if (profile)
+    {
+        cout << "Hardware counters per command: " << flush;
+        testProfile(commands);
+    }
+
+    thoroughf.clear();
+    thoroughf.seekg(0);
+    ostringstream text;
+    text << thoroughf.rdbuf();
+    cout << "Pipelined test on " << commands.size() << " commands: " << flush;
+    testPipelined(text.str(), commands);
+
+    cout << "Binary trace test: " << flush;
+    cout << testTrace(text.str(), commands) << endl;
+
     for (size_t k = 0; k < commands.size(); k++)
         delete commands[k];
 }
@@ -129,9 +225,10 @@ struct JoinCmd : public Command
     JoinCmd(string u, string c, string line, int lineno)
      : Command(line, lineno), m_user(u), m_chat(c)
     {}
-    virtual void execute(ChatTracker& ct) const
+    virtual int execute(ChatTracker& ct) const
     {
         ct.join(m_user, m_chat);
+        return 0;
     }
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const
     {
@@ -148,9 +245,9 @@ struct TerminateCmd : public Command
     TerminateCmd(string c, string line, int lineno)
      : Command(line, lineno), m_chat(c)
     {}
-    virtual void execute(ChatTracker& ct) const
+    virtual int execute(ChatTracker& ct) const
     {
-        ct.terminate(m_chat);
+        return ct.terminate(m_chat);
     }
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const
     {
@@ -164,9 +261,9 @@ struct ContributeCmd : public Command
     ContributeCmd(string u, string line, int lineno)
      : Command(line, lineno), m_user(u)
     {}
-    virtual void execute(ChatTracker& ct) const
+    virtual int execute(ChatTracker& ct) const
     {
-        ct.contribute(m_user);
+        return ct.contribute(m_user);
     }
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const
     {
@@ -180,9 +277,9 @@ struct Leave2Cmd : public Command
     Leave2Cmd(string u, string c, string line, int lineno)
      : Command(line, lineno), m_user(u), m_chat(c)
     {}
-    virtual void execute(ChatTracker& ct) const
+    virtual int execute(ChatTracker& ct) const
     {
-        ct.leave(m_user, m_chat);
+        return ct.leave(m_user, m_chat);
     }
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const
     {
@@ -197,9 +294,9 @@ struct Leave1Cmd : public Command
     Leave1Cmd(string u, string line, int lineno)
      : Command(line, lineno), m_user(u)
     {}
-    virtual void execute(ChatTracker& ct) const
+    virtual int execute(ChatTracker& ct) const
     {
-        ct.leave(m_user);
+        return ct.leave(m_user);
     }
     virtual bool executeAndCheck(ChatTracker& ct, SlowChatTracker& sct) const
     {
@@ -290,6 +387,887 @@ string testCorrectness(const vector<Command*>& commands)
     return "Passed";
 }
 
+  // An idle chat must expire with the total terminate would have returned,
+  // while a chat that keeps getting contributions must not expire
+string testExpiry()
+{
+    ChatTracker ct;
+    vector<pair<string, int>> expired;
+    ct.setChatExpiry(5, [&](const string& chat, int total) {
+        expired.push_back(make_pair(chat, total));
+    }, 2);
+
+    ct.join("Fred", "Breadmaking");
+    ct.contribute("Fred");
+    ct.join("Ethel", "Breadmaking");
+    ct.contribute("Ethel");
+    ct.leave("Ethel");
+    ct.join("Lucy", "Lint Collecting");
+    for (int k = 0; k < 10; k++)
+        ct.contribute("Lucy");
+
+    if (expired.size() != 1  ||  expired[0].first != "Breadmaking"  ||  expired[0].second != 2)
+        return "*** FAILED *** idle chat did not expire with its total";
+    if (ct.contribute("Fred") != 0  ||  ct.terminate("Breadmaking") != 0)
+        return "*** FAILED *** expired chat still has members";
+    if (ct.terminate("Lint Collecting") != 10)
+        return "*** FAILED *** busy chat expired";
+    return "Passed";
+}
+
+  // A reader mapping the tracker's shared region must see what the
+  // tracker itself would report
+string testShared()
+{
+    const char* name = "/ChatTrackerTest";
+    string result = "Passed";
+    try
+    {
+          // a region too small for the tracker must not stay mapped
+        bool tooSmall = false;
+        try
+        {
+            ChatTracker tiny(name, 100);
+        }
+        catch (const bad_alloc&)
+        {
+            tooSmall = true;
+        }
+        SharedRegion::remove(name);
+        ifstream maps("/proc/self/maps");
+        string line;
+        while (getline(maps, line))
+        {
+            if (line.find(name + 1) != string::npos)
+                return "*** FAILED *** region of a tracker that could not be built is still mapped";
+        }
+        if (!tooSmall)
+            return "*** FAILED *** tracker built in a region too small for it";
+
+        ChatTracker ct(name, 1 << 24);
+        ChatTrackerReader reader(name);
+
+        ct.join("Fred", "Breadmaking");
+        ct.contribute("Fred");
+        ct.contribute("Fred");
+        ct.join("Ethel", "Breadmaking");
+        ct.contribute("Ethel");
+        ct.leave("Ethel");
+        ct.join("Fred", "Lint Collecting");
+
+        string chat;
+        int count;
+        if (reader.chatTotal("Breadmaking") != 3)
+            result = "*** FAILED *** wrong chat total";
+        else if (reader.contribution("Fred", "Breadmaking") != 2  ||
+                 reader.contribution("Ethel", "Breadmaking") != -1)
+            result = "*** FAILED *** wrong contribution";
+        else if (!reader.currentChat("Fred", chat, count)  ||
+                 chat != "Lint Collecting"  ||  count != 0)
+            result = "*** FAILED *** wrong current chat";
+        else if (ct.terminate("Breadmaking") != 3  ||  reader.chatTotal("Breadmaking") != 0  ||
+                 reader.contribution("Fred", "Breadmaking") != -1)
+            result = "*** FAILED *** terminated chat still visible";
+    }
+    catch (const exception& e)
+    {
+        result = string("Skipped (") + e.what() + ")";
+    }
+    SharedRegion::remove(name);
+    return result;
+}
+
+  // A snapshot taken halfway through must keep showing the halfway state,
+  // with the totals terminate would have returned then, while the tracker
+  // goes on to run the rest of the commands
+string testSnapshot(const vector<Command*>& commands)
+{
+    size_t half = commands.size() / 2;
+    ChatTracker ct;
+    for (size_t k = 0; k < half; k++)
+        commands[k]->execute(ct);
+
+    ChatSnapshot snap = ct.snapshot();
+    map<string, int> totals;
+    for (ChatSnapshot::const_iterator p = snap.begin(); p != snap.end(); ++p)
+        totals[string((*p).chat)] += (*p).count;
+
+    for (size_t k = half; k < commands.size(); k++)
+        commands[k]->execute(ct);
+
+    map<string, int> later;
+    for (ChatSnapshot::const_iterator p = snap.begin(); p != snap.end(); ++p)
+        later[string((*p).chat)] += (*p).count;
+    if (later != totals)
+        return "*** FAILED *** snapshot changed";
+
+    ChatTracker check;
+    for (size_t k = 0; k < half; k++)
+        commands[k]->execute(check);
+    for (map<string, int>::iterator p = totals.begin(); p != totals.end(); p++)
+    {
+        if (snap.chatTotal(p->first) != p->second  ||  check.terminate(p->first) != p->second)
+            return "*** FAILED *** wrong total for " + p->first;
+    }
+
+      // a name must fit in one page of the snapshot's name columns
+    ChatTracker names;
+    string longest(65536, 'x');
+    names.join(longest, "Breadmaking");
+    try
+    {
+        names.join("Fred", longest + "x");
+        return "*** FAILED *** name over the limit accepted";
+    }
+    catch (const length_error&)
+    {}
+    ChatTracker::Membership current;
+    if (!names.currentChat(longest, current)  ||  current.name != "Breadmaking"  ||
+        names.contribute("Fred") != 0)
+        return "*** FAILED *** rejected name changed the tracker";
+    return "Passed";
+}
+
+  // terminateMany and leaveAll must agree with calling terminate and
+  // leave one at a time, and leave the tracker in the same state
+string testBulk(const vector<Command*>& commands)
+{
+    size_t half = commands.size() / 2;
+    ChatTracker bulk;
+    ChatTracker single;
+    vector<string> users;
+    vector<string> chats;
+    for (size_t k = 0; k < half; k++)
+    {
+        commands[k]->execute(bulk);
+        commands[k]->execute(single);
+        const JoinCmd* j = dynamic_cast<const JoinCmd*>(commands[k]);
+        if (j != nullptr  &&  k % 7 == 0)
+        {
+            users.push_back(j->m_user);
+            chats.push_back(j->m_chat);
+        }
+    }
+    if (chats.empty())
+        return "*** FAILED *** no joins to terminate";
+    chats.push_back("no such chat");
+    chats.push_back(chats[0]);
+
+    vector<int> totals = bulk.terminateMany(chats);
+    for (size_t k = 0; k < chats.size(); k++)
+    {
+        if (totals[k] != single.terminate(chats[k]))
+            return "*** FAILED *** terminateMany total for " + chats[k];
+    }
+      // a missing chat, and one already terminated earlier in the list,
+      // count nothing
+    if (totals[totals.size() - 2] != 0  ||  totals.back() != 0)
+        return "*** FAILED *** terminateMany counted a missing or repeated chat";
+
+    for (size_t k = 0; k < users.size(); k++)
+    {
+        vector<pair<string, int>> left = bulk.leaveAll(users[k]);
+        for (size_t n = 0; n < left.size(); n++)
+        {
+            if (single.leave(users[k], left[n].first) != left[n].second)
+                return "*** FAILED *** leaveAll count for " + users[k];
+        }
+        if (single.leave(users[k]) != -1)
+            return "*** FAILED *** leaveAll missed a chat of " + users[k];
+    }
+
+    for (size_t k = half; k < commands.size(); k++)
+    {
+        if (commands[k]->execute(bulk) != commands[k]->execute(single))
+            return "*** FAILED *** trackers differ afterwards";
+    }
+    return "Passed";
+}
+
+  // Draining the feed after every command must give the events that
+  // command caused, with the values it returned and names that can still
+  // be looked up; a full ring must drop events rather than block
+string testEvents(const vector<Command*>& commands)
+{
+    ChatTracker ct;
+    ct.enableEvents(64);
+    ChatEvent events[64];
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        int result = commands[k]->execute(ct);
+        size_t n = ct.drainEvents(events, 64);
+        const string& line = commands[k]->m_line;
+        for (size_t e = 0; e < n; e++)
+        {
+            string user(ct.userName(events[e].user));
+            string chat(ct.chatName(events[e].chat));
+            if (chat.empty()  ||  (events[e].op != ChatEvent::Terminate  &&  user.empty()))
+                return "*** FAILED *** unknown name in event for " + line;
+            if (line.find(chat) == string::npos  &&  line[0] != 'c'  &&  line[0] != 'l')
+                return "*** FAILED *** wrong chat in event for " + line;
+            if (events[e].op != ChatEvent::Join  &&  events[e].value != result)
+                return "*** FAILED *** wrong value in event for " + line;
+        }
+          // a join that changes nothing, or a terminate of a chat that does
+          // not exist, has no event
+        bool missing = (line[0] == 'c' ? result != 0 :
+                        line[0] == 'l' ? result != -1 :
+                        line[0] == 't' ? result != 0 : false);
+        if (n > 1  ||  (missing  &&  n == 0)  ||  (line[0] == 'c'  &&  result == 0  &&  n != 0))
+            return "*** FAILED *** wrong number of events for " + line;
+    }
+
+    ChatTracker small;
+    small.enableEvents(4);
+    small.join("Fred", "Breadmaking");
+    for (int k = 0; k < 9; k++)
+        small.contribute("Fred");
+    if (small.drainEvents(events, 64) != 4  ||  small.droppedEvents() != 6  ||
+        events[3].op != ChatEvent::Contribute  ||  events[3].value != 3)
+        return "*** FAILED *** overflow did not drop the newest events";
+
+      // a terminate whose event is dropped must not give up an id that an
+      // earlier, undrained Terminate event is still holding
+    ChatTracker full;
+    full.enableEvents(8);
+    full.join("u7", "c5");
+    for (const char* user : { "a", "b" })
+    {
+        full.join(user, "X");
+        full.contribute(user);
+        full.leave(user);
+        full.terminate("X");
+    }
+    full.drainEvents(events, 64);
+    full.join("u8", "X");
+    full.contribute("u8");
+    if (full.contribute("u7") != 1  ||  full.terminate("c5") != 1  ||  full.terminate("X") != 1)
+        return "*** FAILED *** dropped Terminate event released a chat twice";
+
+      // a user with nothing left in the tracker keeps its name until its
+      // events are drained, and then gives it up
+    ChatTracker gone;
+    gone.enableEvents(8);
+    gone.join("Ethel", "Breadmaking");
+    gone.leave("Ethel");
+    gone.terminate("Breadmaking");
+    gone.join("Fred", "Lint Collecting");
+    if (gone.drainEvents(events, 2) != 2  ||  gone.userName(events[1].user) != "Ethel")
+        return "*** FAILED *** a departed user's name went before its events";
+    uint32_t ethel = events[1].user;
+    gone.drainEvents(events, 64);
+    gone.contribute("Fred");
+    if (!gone.userName(ethel).empty())
+        return "*** FAILED *** a departed user's name was kept";
+    return "Passed";
+}
+
+  // Performs c on t, which may be anything with ChatTracker's join,
+  // terminate, contribute and two leaves, and returns what it returns (0
+  // for a join)
+template <typename T>
+long long replay(const Command* c, T& t)
+{
+    if (const JoinCmd* j = dynamic_cast<const JoinCmd*>(c))
+    {
+        t.join(j->m_user, j->m_chat);
+        return 0;
+    }
+    if (const TerminateCmd* x = dynamic_cast<const TerminateCmd*>(c))
+        return t.terminate(x->m_chat);
+    if (const ContributeCmd* n = dynamic_cast<const ContributeCmd*>(c))
+        return t.contribute(n->m_user);
+    if (const Leave2Cmd* l = dynamic_cast<const Leave2Cmd*>(c))
+        return t.leave(l->m_user, l->m_chat);
+    if (const Leave1Cmd* l = dynamic_cast<const Leave1Cmd*>(c))
+        return t.leave(l->m_user);
+    return 0;
+}
+
+  // Users and chats numbered by the caller, 64-bit counts, and departed
+  // memberships folded into their chat's total
+struct NumberedPolicy
+{
+    using Key = uint32_t;
+    using Count = long long;
+    using Hash = hash<string_view>;
+    static const bool keepDeparted = false;
+};
+
+  // A tracker with a different policy must return what ChatTracker does
+string testPolicy(const vector<Command*>& commands)
+{
+    struct Numbered
+    {
+        BasicChatTracker<NumberedPolicy> bt;
+        map<string, uint32_t> users;
+        map<string, uint32_t> chats;
+        static uint32_t id(map<string, uint32_t>& ids, const string& name)
+        {
+            return ids.insert(make_pair(name, uint32_t(ids.size()))).first->second;
+        }
+        void join(const string& u, const string& c) { bt.join(id(users, u), id(chats, c)); }
+        long long terminate(const string& c) { return bt.terminate(id(chats, c)); }
+        long long contribute(const string& u) { return bt.contribute(id(users, u)); }
+        long long leave(const string& u, const string& c) { return bt.leave(id(users, u), id(chats, c)); }
+        long long leave(const string& u) { return bt.leave(id(users, u)); }
+    };
+
+    ChatTracker ct;
+    Numbered nt;
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        if (replay(c, nt) != c->execute(ct))
+            return "*** FAILED *** different result for " + c->m_line;
+    }
+
+      // events must carry counts too big for an int
+    BasicChatTracker<NumberedPolicy> wide;
+    wide.enableEvents(8, ChatEventFeed::DropNewest);
+    wide.join(1, 1);
+    wide.contribute(1, 3000000000LL);
+    ChatEvent events[8];
+    if (wide.terminate(1) != 3000000000LL  ||  wide.drainEvents(events, 8) != 3  ||
+        events[1].value != 3000000000LL  ||  events[2].value != 3000000000LL)
+        return "*** FAILED *** event value cut short";
+
+      // a key too big to be an id must be refused, not cut short
+    struct WidePolicy : NumberedPolicy
+    {
+        using Key = uint64_t;
+    };
+    BasicChatTracker<WidePolicy> big;
+    big.join(1, 2);
+    big.contribute(1);
+    int refused = 0;
+    for (uint64_t key : { 0xFFFFFFFFULL, 0x100000001ULL })
+    {
+        try
+        {
+            big.join(key, 2);
+        }
+        catch (const out_of_range&)
+        {
+            refused++;
+        }
+    }
+    if (refused != 2  ||  big.contribute(0x100000001ULL) != 0  ||  big.contribute(1) != 2)
+        return "*** FAILED *** a key too big to be an id was taken";
+    return "Passed";
+}
+
+  // Numbered users and chats must behave like named ones, even when both
+  // kinds are used in one tracker.  Chats are numbered sparsely; a user is
+  // numbered if its name has an even length, and named otherwise.
+string testNumbers(const vector<Command*>& commands)
+{
+    struct Mixed
+    {
+        ChatTracker nt;
+        map<string, uint64_t> numbers;
+        uint64_t number(const string& name)
+        {
+            return numbers.insert(make_pair(name, (numbers.size() + 1) * 0x9E3779B97F4A7C15ULL)).first->second;
+        }
+        static bool numbered(const string& user) { return user.size() % 2 == 0; }
+        void join(const string& u, const string& c)
+        {
+            if (numbered(u))
+                nt.join(number(u), number(c));
+            else
+                nt.join(u, c);
+        }
+          // the chat may have been joined by number, by name, or both
+        int terminate(const string& c) { return nt.terminate(number(c)) + nt.terminate(c); }
+        int contribute(const string& u) { return numbered(u) ? nt.contribute(number(u)) : nt.contribute(u); }
+        int leave(const string& u, const string& c)
+        {
+            return numbered(u) ? nt.leave(number(u), number(c)) : nt.leave(u, c);
+        }
+        int leave(const string& u) { return numbered(u) ? nt.leave(number(u)) : nt.leave(u); }
+    };
+
+    ChatTracker ct;
+    Mixed mt;
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        if (replay(c, mt) != c->execute(ct))
+            return "*** FAILED *** different result for " + c->m_line;
+    }
+    return "Passed";
+}
+
+  // A tracker whose contributes are combined in a (small, so that entries
+  // collide) cache must return what an ordinary one does, including for
+  // contributes of several at once
+string testCombining(const vector<Command*>& commands)
+{
+    ChatTracker ct;
+    ChatTracker wt;
+    wt.setContributeCache(8);
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        const ContributeCmd* n = dynamic_cast<const ContributeCmd*>(c);
+        if (n != nullptr  &&  k % 3 == 0)
+        {
+            int times = int(k % 5);
+            if (ct.contribute(n->m_user, times) != wt.contribute(n->m_user, times))
+                return "*** FAILED *** different result for contributing " + to_string(times) + " in " + c->m_line;
+        }
+        else if (c->execute(ct) != c->execute(wt))
+            return "*** FAILED *** different result for " + c->m_line;
+    }
+    return "Passed";
+}
+
+  // A router must return what a single tracker does, before and after it
+  // grows and shrinks
+string testRouter(const vector<Command*>& commands)
+{
+    ChatTracker ct;
+    ChatRouter router(3);
+    size_t third = commands.size() / 3;
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        if (k == third)
+            router.setPartitions(5);
+        else if (k == 2 * third)
+            router.setPartitions(2);
+        const Command* c = commands[k];
+        if (replay(c, router) != c->execute(ct))
+            return "*** FAILED *** different result for " + c->m_line;
+    }
+    return "Passed";
+}
+
+  // Moving departed memberships to a cold file must not change any result,
+  // and what was moved must add up to what terminate counts for it
+string testCold(const vector<Command*>& commands)
+{
+    const char* path = "testChatTracker.cold";
+    string result = "Passed";
+    {
+        ChatTracker ct;
+        ChatTracker cold;
+        cold.setColdStorage(path, 50, 8);
+        size_t moved = 0;
+        for (size_t k = 0; k < commands.size()  &&  result == "Passed"; k++)
+        {
+            const Command* c = commands[k];
+            int coldTotal = 0;
+            const TerminateCmd* t = dynamic_cast<const TerminateCmd*>(c);
+            if (t != nullptr)
+            {
+                vector<pair<string, int>> m = cold.coldMemberships(t->m_chat);
+                for (size_t j = 0; j < m.size(); j++)
+                    coldTotal += m[j].second;
+                moved += m.size();
+            }
+            int expected = c->execute(ct);
+            if (c->execute(cold) != expected  ||  (t != nullptr  &&  coldTotal > expected))
+                result = "*** FAILED *** different result for " + c->m_line;
+        }
+        if (result == "Passed"  &&  moved == 0)
+            result = "*** FAILED *** nothing was moved";
+    }
+    remove(path);
+    if (result != "Passed")
+        return result;
+
+      // in a chat whose members mostly stay, those who left wait at the end
+      // of its list and are the only ones moved
+    {
+        ChatTracker ct;
+        ct.setColdStorage(path, 1000, 8);
+        for (int k = 0; k < 2000; k++)
+            ct.join("u" + to_string(k), "Big");
+        for (int k = 0; k < 2000; k += 5)
+        {
+            ct.contribute("u" + to_string(k));
+            ct.leave("u" + to_string(k));
+        }
+        size_t hot = 0;
+        bool left = false;
+        ChatTracker::MembershipRange r = ct.members("Big");
+        for (ChatTracker::MembershipRange::const_iterator p = r.begin(); p != r.end(); ++p)
+        {
+            if ((*p).current  &&  left)
+                result = "*** FAILED *** a departed member before a current one";
+            left = left  ||  !(*p).current;
+            hot += ((*p).current ? 0 : 1);
+        }
+        if (result == "Passed"  &&  (hot > 16  ||  hot + ct.coldMemberships("Big").size() != 400))
+            result = "*** FAILED *** departed members not all moved";
+        if (result == "Passed"  &&  ct.terminate("Big") != 400)
+            result = "*** FAILED *** wrong total for Big";
+    }
+    remove(path);
+    if (result != "Passed")
+        return result;
+
+      // the runs of terminated chats must not pile up in the file, once it
+      // is compacted
+    {
+        ChatTracker ct;
+        ct.setColdStorage(path, 1000, 8);
+        for (int r = 0; r <= 2000; r++)
+        {
+            string chat = (r == 0 ? "Keep" : "c" + to_string(r));
+            for (int k = 0; k < 16; k++)
+            {
+                string user = "u" + to_string(k);
+                ct.join(user, chat);
+                ct.contribute(user);
+                ct.leave(user);
+            }
+            if (r != 0  &&  ct.terminate(chat) != 16)
+                result = "*** FAILED *** wrong total for " + chat;
+        }
+        if (result == "Passed"  &&  ct.coldOrphanedBytes() * 2 < ct.coldBytes())
+            result = "*** FAILED *** terminated chats' runs not counted as orphaned";
+        ct.compactCold();
+        if (result == "Passed"  &&  (ct.coldBytes() > 200000  ||  ct.coldOrphanedBytes() != 0))
+            result = "*** FAILED *** orphaned runs kept: " + to_string(ct.coldOrphanedBytes()) +
+                     " of " + to_string(ct.coldBytes()) + " bytes";
+        if (result == "Passed"  &&  (ct.coldMemberships("Keep").size() != 16  ||  ct.terminate("Keep") != 16))
+            result = "*** FAILED *** compaction lost a chat's runs";
+    }
+    remove(path);
+    return result;
+}
+
+  // A reset tracker must behave like a new one, and must leave a snapshot
+  // taken before the reset unchanged
+string testReset(const vector<Command*>& commands)
+{
+    ChatTracker ct;
+    for (size_t k = 0; k < commands.size(); k++)
+        commands[k]->execute(ct);
+    ChatSnapshot before = ct.snapshot();
+    auto sum = [](const ChatSnapshot& s) {
+        long long total = 0;
+        for (ChatSnapshot::const_iterator it = s.begin(); it != s.end(); ++it)
+            total += (*it).count;
+        return total;
+    };
+    long long expected = sum(before);
+
+    ct.reset();
+    ChatTracker fresh;
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        if (c->execute(ct) != c->execute(fresh))
+            return "*** FAILED *** different result after reset for " + c->m_line;
+    }
+    if (sum(before) != expected)
+        return "*** FAILED *** reset changed an earlier snapshot";
+    return "Passed";
+}
+
+  // Before each command, the queries must predict what it returns.  The
+  // contribute cache is on, so the queries must count what it holds.
+string testQueries(const vector<Command*>& commands)
+{
+    ChatTracker ct;
+    ct.setContributeCache(8);
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        int expected = 0;
+        ChatTracker::Membership current;
+        if (const TerminateCmd* t = dynamic_cast<const TerminateCmd*>(c))
+        {
+            ChatTracker::MembershipRange r = ct.members(t->m_chat);
+            for (ChatTracker::MembershipRange::const_iterator p = r.begin(); p != r.end(); ++p)
+            {
+                expected += (*p).count;
+                if ((*p).current  &&  ct.contribution((*p).name, t->m_chat) != (*p).count)
+                    return "*** FAILED *** members and contribution disagree before " + c->m_line;
+            }
+        }
+        else if (const ContributeCmd* n = dynamic_cast<const ContributeCmd*>(c))
+            expected = ct.currentChat(n->m_user, current) ? current.count + 1 : 0;
+        else if (const Leave2Cmd* l = dynamic_cast<const Leave2Cmd*>(c))
+            expected = ct.contribution(l->m_user, l->m_chat);
+        else if (const Leave1Cmd* l = dynamic_cast<const Leave1Cmd*>(c))
+        {
+            expected = ct.currentChat(l->m_user, current) ? current.count : -1;
+            ChatTracker::MembershipRange r = ct.chatsOf(l->m_user);
+            if (!r.empty()  &&  (*r.begin()).name != current.name)
+                return "*** FAILED *** chatsOf and currentChat disagree before " + c->m_line;
+        }
+        if (c->execute(ct) != expected)
+            return "*** FAILED *** queries did not predict " + c->m_line;
+    }
+    return "Passed";
+}
+
+  // Counts the bytes a tracker has taken from it
+class CountingResource : public std::pmr::memory_resource
+{
+  public:
+    size_t inUse = 0;
+    size_t allocations = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t align) override
+    {
+        inUse += bytes;
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override
+    {
+        inUse -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+  // A tracker given a memory resource must allocate from it, give back
+  // everything it took, and return what any other tracker does
+string testResource(const vector<Command*>& commands)
+{
+    CountingResource counting;
+    {
+        ChatTracker reference;
+        ChatTracker ct(20000, &counting);
+        ct.enableEvents(1024, ChatEventFeed::DropOldest);
+        ct.setContributeCache(16);
+        for (size_t k = 0; k < commands.size(); k++)
+        {
+            const Command* c = commands[k];
+            if (c->execute(ct) != c->execute(reference))
+                return "*** FAILED *** different result for " + c->m_line;
+        }
+        if (counting.inUse == 0)
+            return "*** FAILED *** nothing came from the resource";
+        size_t before = counting.allocations;
+        ct.reset();
+        for (size_t k = 0; k < commands.size(); k++)
+            commands[k]->execute(ct);
+        if (counting.allocations - before >= before / 2)
+            return "*** FAILED *** refilling after reset allocated " + to_string(counting.allocations - before) + " times, against " + to_string(before);
+    }
+
+      // names that fill several pages must go back into the pages kept
+    {
+        ChatTracker ct(20000, &counting);
+        auto fill = [&ct] {
+            for (int k = 0; k < 50000; k++)
+                ct.join("a user with a longish name " + to_string(k), "chat " + to_string(k % 500));
+        };
+        size_t start = counting.allocations;
+        fill();
+        size_t first = counting.allocations - start;
+        ct.reset();
+        start = counting.allocations;
+        fill();
+        size_t again = counting.allocations - start;
+        if (again >= first / 10)
+            return "*** FAILED *** refilling names after reset allocated " + to_string(again) + " times, against " + to_string(first);
+    }
+    if (counting.inUse != 0)
+        return "*** FAILED *** " + to_string(counting.inUse) + " bytes not given back";
+
+      // users who have come and gone must not pile up: once their
+      // memberships are freed, so are their ids and names
+    {
+        ChatTracker ct(20000, &counting);
+        ct.setChatExpiry(100, nullptr, 4);
+        ct.enableEvents(1024, ChatEventFeed::DropOldest);
+        size_t settled = 0;
+        for (int r = 0; r < 6; r++)
+        {
+            for (int k = 0; k < 20000; k++)
+            {
+                string user = "r" + to_string(r) + "u" + to_string(k);
+                string chat = "r" + to_string(r) + "c" + to_string(k / 100);
+                ct.join(user, chat);
+                ct.contribute(user);
+                ct.leave(user);
+                if (k % 100 == 99)
+                    ct.terminate(chat);
+            }
+            if (r == 2)
+                settled = counting.inUse;
+        }
+        if (counting.inUse > settled + settled / 10)
+            return "*** FAILED *** memory grew from " + to_string(settled) + " to " + to_string(counting.inUse) + " bytes";
+    }
+    return "Passed";
+}
+
+  // Terminating a huge chat must answer at once and leave its members as
+  // if they had never joined it, and the slots it frees later must be
+  // used again instead of new ones
+string testDeferred()
+{
+    const int N = 200000;
+    vector<string> users;
+    for (int k = 0; k < N; k++)
+        users.push_back("u" + to_string(k));
+
+    CountingResource counting;
+    ChatTracker ct(20000, &counting);
+    ct.join("Fred", "Breadmaking");
+    ct.join("Fred", "Huge");
+    ct.contribute("Fred", 3);
+    for (int k = 0; k < N; k++)
+    {
+        ct.join(users[k], "Lobby");
+        ct.join(users[k], "Huge");
+        ct.contribute(users[k]);
+    }
+    if (ct.terminate("Huge") != N + 3)
+        return "*** FAILED *** wrong total";
+
+    ChatTracker::Membership current;
+    if (!ct.currentChat("Fred", current)  ||  current.name != "Breadmaking"  ||
+        ct.contribution("Fred", "Huge") != -1  ||  ct.contribution(users[0], "Huge") != -1  ||
+        ct.contribute(users[0]) != 1)
+        return "*** FAILED *** terminated chat still has members";
+    ct.join("Fred", "Huge");
+    if (ct.contribute("Fred") != 1  ||  ct.members("Huge").empty()  ||
+        ++ct.members("Huge").begin() != ct.members("Huge").end())
+        return "*** FAILED *** joining again did not start the chat over";
+
+      // every operation frees a few slots, so these joins reuse them all
+      // (the users' departed Lobby memberships keep their names)
+    for (int k = 0; k < N; k++)
+        ct.leave(users[k]);
+    size_t before = counting.allocations;
+    for (int k = 0; k < N; k++)
+        ct.join(users[k], "Huger");
+    if (counting.allocations - before > 10)
+        return "*** FAILED *** freed slots were not reused";
+
+    ChatSnapshot snap = ct.snapshot();
+    for (ChatSnapshot::const_iterator p = snap.begin(); p != snap.end(); ++p)
+    {
+        if ((*p).chat == "Huge"  &&  (*p).user != "Fred")
+            return "*** FAILED *** snapshot lists a terminated membership";
+    }
+    if (ct.terminate("Huge") != 1  ||  ct.terminate("Huger") != 0)
+        return "*** FAILED *** wrong total after joining again";
+    return "Passed";
+}
+
+  // Replaying a trace converted from text, or one recorded by a tracker,
+  // must give the same results as the text commands, and a damaged trace
+  // must be rejected
+string testTrace(const string& text, const vector<Command*>& commands)
+{
+    istringstream textf(text);
+    ostringstream converted;
+    if (convertChatTrace(textf, converted) != 0)
+        return "*** FAILED *** lines skipped";
+
+    ostringstream recorded;
+    {
+        ChatTracker ct;
+        ChatTraceWriter w(recorded, 4096);
+        ct.setRecorder(&w);
+        for (size_t k = 0; k < commands.size(); k++)
+            commands[k]->execute(ct);
+    }
+
+    string traces[2] = { converted.str(), recorded.str() };
+    for (int t = 0; t < 2; t++)
+    {
+        ChatTraceReader r(traces[t]);
+        ChatTracker replayed;
+        ChatTracker check;
+        ChatCommand cmd;
+        size_t k = 0;
+        for ( ; r.next(cmd); k++)
+        {
+            if (k == commands.size()  ||  replayed.apply(cmd) != commands[k]->execute(check))
+                return "*** FAILED *** replay differs at " + to_string(k);
+        }
+        if (k != commands.size())
+            return "*** FAILED *** trace is short";
+    }
+
+      // a counted contribute is one record, whatever n is
+    ostringstream counted;
+    {
+        ChatTracker ct;
+        ChatTraceWriter w(counted);
+        ct.setRecorder(&w);
+        ct.join("Fred", "Breadmaking");
+        ct.contribute("Fred", 5);
+        ct.contribute("Fred", -2);
+        ct.contribute("Fred", 0);
+        ct.join("Ethel", "Breadmaking");
+        ct.contribute("Ethel", 50000000);
+          // a join that is refused is not recorded
+        try
+        {
+            ct.join("Ethel", string(ChatTracker::MAX_NAME + 1, 'x'));
+        }
+        catch (const length_error&)
+        {}
+    }
+    {
+        ChatTraceReader r(counted.str());
+        ChatTracker replayed;
+        ChatCommand cmd;
+        while (r.next(cmd))
+            replayed.apply(cmd);
+        if (counted.str().size() > 100  ||  replayed.terminate("Breadmaking") != 50000003)
+            return "*** FAILED *** counted contributes replay differently";
+    }
+
+      // numbered calls are recorded as numbered commands
+    ostringstream numbered;
+    {
+        ChatTracker ct;
+        ChatTraceWriter w(numbered);
+        ct.setRecorder(&w);
+        ct.join(7, 1);
+        ct.join("Fred", "Breadmaking");
+        ct.contribute(7, 4);
+        ct.contribute(7);
+        ct.join(8, 1);
+        ct.contribute(8);
+        ct.leave(8);
+        ct.contribute("Fred");
+        ct.join(7, 2);
+        ct.leave(7, 2);
+    }
+    {
+        ChatTraceReader r(numbered.str());
+        ChatTracker replayed;
+        ChatCommand cmd;
+        while (r.next(cmd))
+            replayed.apply(cmd);
+        if (replayed.terminate(1) != 6  ||  replayed.terminate(2) != 0  ||  replayed.terminate("Breadmaking") != 1)
+            return "*** FAILED *** numbered commands replay differently";
+    }
+
+    string damaged = traces[0];
+    damaged[damaged.size() / 2] ^= 0x10;
+    try
+    {
+        ChatTraceReader r(damaged);
+        ChatCommand cmd;
+        while (r.next(cmd))
+            ;
+        return "*** FAILED *** damaged trace accepted";
+    }
+    catch (const runtime_error&)
+    {}
+    return "Passed (" + to_string(text.size() / traces[0].size()) + "x smaller than text)";
+}
+
 //========================================================================
 // Timer t;                 // create a timer and start it
 // t.start();               // (re)start the timer
@@ -344,6 +1322,208 @@ void testPerformance(const vector<Command*>& commands)
          << "    Destruction: " << (end - endCommands) << " msec." << endl;
 }
 
+  // A group of hardware counters for this thread, in user mode only, that
+  // count only while enabled
+class CounterGroup
+{
+  public:
+    static const int NUM = 5;
+    static const char* const names[NUM];
+
+    CounterGroup()
+    {
+        for (int k = 0; k < NUM; k++)
+            m_fds[k] = -1;
+    }
+    ~CounterGroup()
+    {
+        for (int k = 0; k < NUM; k++)
+            if (m_fds[k] >= 0)
+                close(m_fds[k]);
+    }
+      // Returns an empty string, or why the counters can't be used
+    string open()
+    {
+#ifdef __linux__
+        const uint32_t types[NUM] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                      PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+        const uint64_t configs[NUM] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int k = 0; k < NUM; k++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[k];
+            attr.config = configs[k];
+            attr.disabled = (k == 0);  // the leader starts the group off
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            m_fds[k] = syscall(SYS_perf_event_open, &attr, 0, -1, k == 0 ? -1 : m_fds[0], 0);
+            if (m_fds[k] < 0)
+                return string("cannot open ") + names[k] + " counter: " + strerror(errno);
+        }
+        return "";
+#else
+        return "hardware counters are only read on Linux";
+#endif
+    }
+    void enable()
+    {
+#ifdef __linux__
+        ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    void disable()
+    {
+#ifdef __linux__
+        ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+      // The totals so far, scaled up if the kernel had to share the hardware
+    void read(double totals[NUM])
+    {
+        uint64_t buf[3 + NUM] = { 0 };
+        if (::read(m_fds[0], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)))
+            buf[1] = buf[2] = 0;
+        double scale = (buf[2] == 0 ? 0 : double(buf[1]) / buf[2]);
+        for (int k = 0; k < NUM; k++)
+            totals[k] = buf[3 + k] * scale;
+    }
+  private:
+    int m_fds[NUM];
+};
+
+const char* const CounterGroup::names[CounterGroup::NUM] =
+    { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+
+  // Runs the commands again with a separate counter group for each command
+  // type, enabled just around each command of that type.  What enabling
+  // and disabling a group costs by itself is measured with one more group
+  // and taken off.
+void testProfile(const vector<Command*>& commands)
+{
+    const int TYPES = 5;
+    const char* typeNames[TYPES] = { "join", "contribute", "leave1", "leave2", "terminate" };
+    vector<int> types;
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        const Command* c = commands[k];
+        types.push_back(dynamic_cast<const JoinCmd*>(c) ? 0 :
+                        dynamic_cast<const ContributeCmd*>(c) ? 1 :
+                        dynamic_cast<const Leave1Cmd*>(c) ? 2 :
+                        dynamic_cast<const Leave2Cmd*>(c) ? 3 : 4);
+    }
+
+    CounterGroup groups[TYPES + 1];
+    for (int t = 0; t <= TYPES; t++)
+    {
+        string error = groups[t].open();
+        if ( ! error.empty())
+        {
+            cout << "Skipped (" << error << ")" << endl;
+            return;
+        }
+    }
+
+    size_t counts[TYPES] = { 0 };
+    {
+        ChatTracker ct;
+        for (size_t k = 0; k < commands.size(); k++)
+        {
+            CounterGroup& g = groups[types[k]];
+            g.enable();
+            commands[k]->execute(ct);
+            g.disable();
+            counts[types[k]]++;
+        }
+    }
+    CounterGroup& empty = groups[TYPES];
+    for (size_t k = 0; k < commands.size(); k++)
+    {
+        empty.enable();
+        empty.disable();
+    }
+
+    double overhead[CounterGroup::NUM];
+    empty.read(overhead);
+    cout << endl << "    " << setw(10) << "" << setw(8) << "count";
+    for (int n = 0; n < CounterGroup::NUM; n++)
+        cout << setw(15) << CounterGroup::names[n];
+    cout << endl;
+    for (int t = 0; t < TYPES; t++)
+    {
+        if (counts[t] == 0)
+            continue;
+        double totals[CounterGroup::NUM];
+        groups[t].read(totals);
+        cout << "    " << setw(10) << typeNames[t] << setw(8) << counts[t];
+        for (int n = 0; n < CounterGroup::NUM; n++)
+        {
+            double perOp = (totals[n] - overhead[n] * counts[t] / commands.size()) / counts[t];
+            cout << setw(15) << fixed << setprecision(1) << (perOp < 0 ? 0 : perOp);
+        }
+        cout << endl;
+    }
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
+  // Parses and applies the same commands through a ChatPipeline, checking
+  // that every result matches applying them one at a time
+void testPipelined(const string& text, const vector<Command*>& commands)
+{
+      // a name join would refuse makes the line malformed, instead of
+      // throwing on the applying thread
+    {
+        string bad = "j Fred " + string(ChatTracker::MAX_NAME + 1, 'x') + "\nj Fred Breadmaking\nc Fred\n";
+        vector<int> results;
+        ChatTracker ct;
+        ChatPipeline pipeline(ct, 16, &results);
+        pipeline.parse(bad.data(), bad.size());
+        pipeline.drain();
+        if (pipeline.malformedLines() != 1  ||  results.size() != 2  ||  results[1] != 1)
+        {
+            cout << "*** FAILED *** long name not rejected" << endl;
+            return;
+        }
+    }
+
+    vector<int> expected;
+    {
+        ChatTracker ct;
+        for (size_t k = 0; k < commands.size(); k++)
+            expected.push_back(commands[k]->execute(ct));
+    }
+
+    vector<int> results;
+    results.reserve(commands.size());
+    Timer timer;
+    {
+        ChatTracker ct;
+        ChatPipeline pipeline(ct, 4096, &results);
+        pipeline.parse(text.data(), text.size());
+        pipeline.drain();
+    }
+    double end = timer.elapsed();
+
+    if (results != expected)
+    {
+        size_t k = 0;
+        while (k < results.size()  &&  k < expected.size()  &&  results[k] == expected[k])
+            k++;
+        cout << "*** FAILED *** at command " << k << endl;
+        return;
+    }
+    cout << end << " milliseconds (parsing included)." << endl;
+}
+
 void SlowChatTracker::join(string user, string chat)
 {
     vector<Info>::iterator p = m_info.end();